@@ -869,6 +869,10 @@
 #define INSN_MASK_FENCE_TSO		0xffffffff
 #define INSN_MATCH_FENCE_TSO		0x8330000f
 
+#define INSN_MASK_RDTIME		0xfffff07f
+#define INSN_MATCH_RDTIME		0xc0102073
+#define INSN_MATCH_RDTIMEH		0xc8102073
+
 #if __riscv_xlen == 64
 
 /* 64-bit read for VS-stage address translation (RV64) */
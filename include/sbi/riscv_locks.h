@@ -12,6 +12,35 @@
 
 #define TICKET_SHIFT	16
 
+#ifdef CONFIG_SBI_LOCK_STATS
+
+/** Contention statistics of a firmware spinlock */
+struct spin_lock_stats {
+	/** Name given to the lock at initialization time */
+	const char *name;
+	/** Set once the lock is in the statistics table */
+	unsigned long registered;
+	/** Number of acquisitions */
+	unsigned long acquired;
+	/** Number of acquisitions which had to wait */
+	unsigned long contended;
+	/** Total spin iterations over all contended acquisitions */
+	unsigned long spins;
+	/** Total wait cycles over all contended acquisitions */
+	unsigned long wait_cycles;
+	/** Maximum wait cycles of a single acquisition */
+	unsigned long max_wait_cycles;
+};
+
+#define __SPIN_LOCK_STATS_INIT(_name)	\
+	, { .name = (_name) }
+
+#else
+
+#define __SPIN_LOCK_STATS_INIT(_name)
+
+#endif
+
 typedef struct {
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
        u16 next;
@@ -20,13 +49,19 @@ typedef struct {
        u16 owner;
        u16 next;
 #endif
+#ifdef CONFIG_SBI_LOCK_STATS
+       struct spin_lock_stats stats;
+#endif
 } __aligned(4) spinlock_t;
 
+#define __SPIN_LOCK_UNLOCKED_NAMED(_name)	\
+	(spinlock_t) { 0, 0 __SPIN_LOCK_STATS_INIT(_name) }
+
 #define __SPIN_LOCK_UNLOCKED	\
-	(spinlock_t) { 0, 0 }
+	__SPIN_LOCK_UNLOCKED_NAMED(NULL)
 
 #define SPIN_LOCK_INIT(x)	\
-	x = __SPIN_LOCK_UNLOCKED
+	x = __SPIN_LOCK_UNLOCKED_NAMED(#x)
 
 #define SPIN_LOCK_INITIALIZER	\
 	__SPIN_LOCK_UNLOCKED
@@ -34,6 +69,43 @@ typedef struct {
 #define DEFINE_SPIN_LOCK(x)	\
 	spinlock_t SPIN_LOCK_INIT(x)
 
+/** Maximum number of MCS spinlocks a HART can hold (or wait on) at once */
+#define MCS_SPIN_LOCK_MAX_NESTING	4
+
+/**
+ * Per-HART queue node of MCS spinlock
+ *
+ * Each waiter spins on the locked member of its own node so contention
+ * does not bounce the cache line holding the lock word across HARTs.
+ */
+struct mcs_spinlock_node {
+	struct mcs_spinlock_node *next;
+	void *lock;
+	unsigned long locked;
+};
+
+typedef struct {
+	struct mcs_spinlock_node *tail;
+#ifdef CONFIG_SBI_LOCK_STATS
+	struct spin_lock_stats stats;
+#endif
+} mcs_spinlock_t;
+
+#define __MCS_SPIN_LOCK_UNLOCKED_NAMED(_name)	\
+	(mcs_spinlock_t) { NULL __SPIN_LOCK_STATS_INIT(_name) }
+
+#define __MCS_SPIN_LOCK_UNLOCKED	\
+	__MCS_SPIN_LOCK_UNLOCKED_NAMED(NULL)
+
+#define MCS_SPIN_LOCK_INIT(x)	\
+	x = __MCS_SPIN_LOCK_UNLOCKED_NAMED(#x)
+
+#define MCS_SPIN_LOCK_INITIALIZER	\
+	__MCS_SPIN_LOCK_UNLOCKED
+
+#define DEFINE_MCS_SPIN_LOCK(x)	\
+	mcs_spinlock_t MCS_SPIN_LOCK_INIT(x)
+
 bool spin_lock_check(spinlock_t *lock);
 
 bool spin_trylock(spinlock_t *lock);
@@ -42,4 +114,28 @@ void spin_lock(spinlock_t *lock);
 
 void spin_unlock(spinlock_t *lock);
 
+int mcs_spin_lock_init(void);
+
+bool mcs_spin_lock_check(mcs_spinlock_t *lock);
+
+bool mcs_spin_trylock(mcs_spinlock_t *lock);
+
+void mcs_spin_lock(mcs_spinlock_t *lock);
+
+void mcs_spin_unlock(mcs_spinlock_t *lock);
+
+#ifdef CONFIG_SBI_LOCK_STATS
+
+void spin_lock_stats_dump(void);
+
+void spin_lock_stats_reset(void);
+
+#else
+
+static inline void spin_lock_stats_dump(void) { }
+
+static inline void spin_lock_stats_reset(void) { }
+
+#endif
+
 #endif
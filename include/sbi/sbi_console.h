@@ -10,6 +10,7 @@
 #ifndef __SBI_CONSOLE_H__
 #define __SBI_CONSOLE_H__
 
+#include <sbi/sbi_error.h>
 #include <sbi/sbi_types.h>
 
 struct sbi_console_device {
@@ -24,6 +25,9 @@ struct sbi_console_device {
 
 	/** Read a character from the console input */
 	int (*console_getc)(void);
+
+	/** Enable the receive interrupt of the console */
+	int (*console_rx_irq_enable)(void);
 };
 
 #define __printf(a, b) __attribute__((format(printf, a, b)))
@@ -38,10 +42,31 @@ void sbi_puts(const char *str);
 
 unsigned long sbi_nputs(const char *str, unsigned long len);
 
+#ifdef CONFIG_SBI_CONSOLE_ASYNC
+void sbi_console_flush(void);
+
+/** Drain all log rings and bypass them from now on */
+void sbi_console_sync(void);
+#else
+static inline void sbi_console_flush(void) { }
+
+static inline void sbi_console_sync(void) { }
+#endif
+
 void sbi_gets(char *s, int maxwidth, char endchar);
 
 unsigned long sbi_ngets(char *str, unsigned long len);
 
+#ifdef CONFIG_SBI_CONSOLE_RX_IRQ
+int sbi_console_rx_irq_enable(void);
+
+void sbi_console_rx_process(void);
+#else
+static inline int sbi_console_rx_irq_enable(void) { return SBI_ENOTSUPP; }
+
+static inline void sbi_console_rx_process(void) { }
+#endif
+
 int __printf(2, 3) sbi_sprintf(char *out, const char *format, ...);
 
 int __printf(3, 4) sbi_snprintf(char *out, u32 out_sz, const char *format, ...);
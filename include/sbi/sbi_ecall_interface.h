@@ -34,6 +34,9 @@
 #define SBI_EXT_CPPC				0x43505043
 #define SBI_EXT_DBTR				0x44425452
 
+/* OpenSBI firmware-specific extensions */
+#define SBI_EXT_FWDIAG				0x0A000001
+
 /* SBI function IDs for BASE extension*/
 #define SBI_EXT_BASE_GET_SPEC_VERSION		0x0
 #define SBI_EXT_BASE_GET_IMP_ID			0x1
@@ -250,6 +253,8 @@ enum sbi_pmu_ctr_type {
 #define SBI_PMU_CFG_FLAG_SET_UINH	(1 << 5)
 #define SBI_PMU_CFG_FLAG_SET_SINH	(1 << 6)
 #define SBI_PMU_CFG_FLAG_SET_MINH	(1 << 7)
+/* OpenSBI specific, time multiplex when no hardware counter is free */
+#define SBI_PMU_CFG_FLAG_MULTIPLEX	(1 << 16)
 
 /* Flags defined for counter start function */
 #define SBI_PMU_START_FLAG_SET_INIT_VALUE (1 << 0)
@@ -304,6 +309,15 @@ enum sbi_cppc_reg_id {
 	SBI_CPPC_NON_ACPI_LAST		= SBI_CPPC_TRANSITION_LATENCY,
 };
 
+/* SBI function IDs for OpenSBI firmware diagnostics extension */
+#define SBI_EXT_FWDIAG_LOCK_STATS_DUMP		0x0
+#define SBI_EXT_FWDIAG_LOCK_STATS_RESET		0x1
+#define SBI_EXT_FWDIAG_TRACE_DUMP		0x2
+#define SBI_EXT_FWDIAG_TRACE_RESET		0x3
+#define SBI_EXT_FWDIAG_TRAP_PROFILE_READ	0x4
+#define SBI_EXT_FWDIAG_TRAP_PROFILE_RESET	0x5
+#define SBI_EXT_FWDIAG_PMU_COUNTERS_READ	0x6
+
 /* SBI base specification related macros */
 #define SBI_SPEC_VERSION_MAJOR_OFFSET		24
 #define SBI_SPEC_VERSION_MAJOR_MASK		0x7f
@@ -98,6 +98,34 @@ struct sbi_pmu_device {
 	void (*hw_counter_filter_mode)(unsigned long flags, int counter_index);
 };
 
+/** Size and alignment of the counter snapshot shared memory */
+#define SBI_PMU_SNAPSHOT_ALIGN		4096
+
+/** Maximum number of firmware event sources */
+#define SBI_PMU_FW_SOURCE_MAX		4
+
+/*
+ * Event data of SBI_PMU_FW_PLATFORM events counted by OpenSBI itself
+ * carries the tag of the source in bits [31:16].
+ */
+#define SBI_PMU_FW_SOURCE_TAG_SHIFT	16
+#define SBI_PMU_FW_SOURCE_TAG_MASK	0xffff
+
+/** Source of SBI_PMU_FW_PLATFORM events counted by OpenSBI itself */
+struct sbi_pmu_fw_source {
+	/** Tag matched against event data bits [31:16] */
+	u16 tag;
+
+	/** Check the remaining event data bits (optional) */
+	bool (*event_valid)(uint64_t event_data);
+
+	/** Read the free-running count of the event on the current HART */
+	uint64_t (*event_read)(uint64_t event_data);
+};
+
+/** Register a firmware event source, must be called during cold boot */
+int sbi_pmu_register_fw_source(const struct sbi_pmu_fw_source *src);
+
 /** Get the PMU platform device */
 const struct sbi_pmu_device *sbi_pmu_get_device(void);
 
@@ -142,6 +170,17 @@ int sbi_pmu_ctr_start(unsigned long cidx_base, unsigned long cidx_mask,
 
 int sbi_pmu_ctr_get_info(uint32_t cidx, unsigned long *ctr_info);
 
+/**
+ * Set or disable the counter snapshot shared memory of the current HART
+ * @param smode  privilege mode of the caller
+ * @param phys_lo lower XLEN bits of the physical address
+ * @param phys_hi upper XLEN bits of the physical address
+ * @param flags  reserved, must be zero
+ * @return 0 on success, error otherwise.
+ */
+int sbi_pmu_snapshot_set_shmem(unsigned long smode, unsigned long phys_lo,
+			       unsigned long phys_hi, unsigned long flags);
+
 unsigned long sbi_pmu_num_ctr(void);
 
 int sbi_pmu_ctr_cfg_match(unsigned long cidx_base, unsigned long cidx_mask,
@@ -150,4 +189,54 @@ int sbi_pmu_ctr_cfg_match(unsigned long cidx_base, unsigned long cidx_mask,
 
 int sbi_pmu_ctr_incr_fw(enum sbi_pmu_fw_event_code_id fw_id);
 
+/*
+ * Event data of SBI_PMU_FW_PLATFORM events counting M-mode cycles
+ *
+ * [31:16] SBI_PMU_FW_CYCLES_EDATA_TAG
+ * [15:0]  enum sbi_pmu_fw_cycles_event
+ */
+#define SBI_PMU_FW_CYCLES_EDATA_TAG	0x4d43
+
+/** Firmware overhead categories, these overlap */
+enum sbi_pmu_fw_cycles_event {
+	/** All traps handled in C */
+	SBI_PMU_FW_CYCLES_TOTAL = 0,
+	/** SBI calls */
+	SBI_PMU_FW_CYCLES_ECALL,
+	/** Illegal instruction and misaligned access emulation */
+	SBI_PMU_FW_CYCLES_EMULATION,
+	/** Waiting for remote HARTs to complete fences */
+	SBI_PMU_FW_CYCLES_FENCE_WAIT,
+	SBI_PMU_FW_CYCLES_MAX,
+};
+
+#ifdef CONFIG_SBI_PMU_FW_CYCLES
+
+/**
+ * Read the firmware cycle clock of the current HART, which is mcycle
+ * minus the cycles spent suspended
+ */
+unsigned long sbi_pmu_fw_cycles_begin(void);
+
+/** Account the cycles since start to a category of the current HART */
+void sbi_pmu_fw_cycles_end(enum sbi_pmu_fw_cycles_event ev,
+			   unsigned long start);
+
+/** Exclude the cycles since start, spent suspended, from all categories */
+void sbi_pmu_fw_cycles_idle(unsigned long start);
+
+#else
+
+static inline unsigned long sbi_pmu_fw_cycles_begin(void)
+{
+	return 0;
+}
+
+static inline void sbi_pmu_fw_cycles_end(enum sbi_pmu_fw_cycles_event ev,
+					 unsigned long start) { }
+
+static inline void sbi_pmu_fw_cycles_idle(unsigned long start) { }
+
+#endif
+
 #endif
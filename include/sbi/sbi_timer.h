@@ -30,6 +30,33 @@ struct sbi_timer_device {
 	void (*timer_event_stop)(void);
 };
 
+/** Maximum number of M-mode timer events queued per HART */
+#define SBI_TIMER_EVENT_MAX		16
+
+/** M-mode software timer event */
+struct sbi_timer_event {
+	/** Expiry time in timer ticks */
+	u64 expires;
+	/** Called on the owning HART from the timer interrupt handler */
+	void (*callback)(struct sbi_timer_event *ev);
+	/** Position in the HART queue plus one, zero when not queued */
+	u32 slot;
+};
+
+/*
+ * Event data of SBI_PMU_FW_PLATFORM events counted by the timer
+ *
+ * [31:16] SBI_TIMER_PMU_EDATA_TAG
+ * [15:0]  enum sbi_timer_pmu_event
+ */
+#define SBI_TIMER_PMU_EDATA_TAG		0x544d
+
+enum sbi_timer_pmu_event {
+	/** Timer interrupts saved by serving several deadlines at once */
+	SBI_TIMER_PMU_EVENT_COALESCED = 0,
+	SBI_TIMER_PMU_EVENT_MAX,
+};
+
 struct sbi_scratch;
 
 /** Generic delay loop of desired granularity */
@@ -84,6 +111,38 @@ void sbi_timer_set_delta_upper(ulong delta_upper);
 /** Start timer event for current HART */
 void sbi_timer_event_start(u64 next_event);
 
+/**
+ * Queue an M-mode timer event on the current HART
+ *
+ * The event is multiplexed with the S-mode deadline on the HART's timer
+ * compare register. Adding a queued event moves it to the new expiry
+ * time. Events are dropped when the HART stops.
+ *
+ * @param ev event to queue, the callback must be set
+ * @param expires absolute expiry time in timer ticks
+ *
+ * @return 0 on success and negative error code on failure
+ */
+int sbi_timer_event_add(struct sbi_timer_event *ev, u64 expires);
+
+/**
+ * Set the timer slack in microseconds
+ *
+ * Deadlines may be deferred by up to the slack so that those falling
+ * within it are served by a single timer interrupt. Zero disables
+ * coalescing.
+ */
+void sbi_timer_set_slack(ulong usecs);
+
+/** Remove an M-mode timer event from the queue of the current HART */
+void sbi_timer_event_del(struct sbi_timer_event *ev);
+
+/** Check whether an M-mode timer event is queued */
+static inline bool sbi_timer_event_pending(const struct sbi_timer_event *ev)
+{
+	return ev->slot != 0;
+}
+
 /** Process timer event for current HART */
 void sbi_timer_process(void);
 
@@ -0,0 +1,98 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) Nuclei Corporation or its affiliates.
+ */
+
+#ifndef __SBI_TRACE_H__
+#define __SBI_TRACE_H__
+
+#include <sbi/sbi_types.h>
+
+/** Magic value at the start of each per-HART trace ring ("SBTR") */
+#define SBI_TRACE_MAGIC			0x52544253
+
+/** Maximum number of arguments recorded with a trace entry */
+#define SBI_TRACE_MAX_ARGS		4
+
+/**
+ * Binary trace entry
+ *
+ * Only the address of the format string is recorded; formatting is done
+ * offline by scripts/sbi-trace-decode.py using the firmware ELF.
+ */
+struct sbi_trace_entry {
+	/** Value of mcycle when the entry was recorded */
+	unsigned long cycle;
+	/** Run-time address of the printf-style format string */
+	unsigned long fmt;
+	/** Raw arguments */
+	unsigned long arg[SBI_TRACE_MAX_ARGS];
+};
+
+/** Per-HART trace ring as laid out in memory */
+struct sbi_trace_ring {
+	/** SBI_TRACE_MAGIC */
+	u32 magic;
+	/** HART id owning the ring */
+	u32 hartid;
+	/** Size of unsigned long in bytes */
+	u32 word_size;
+	/** Number of entries (power of 2) */
+	u32 nentries;
+	/** Run-time firmware start address for relocatable images */
+	unsigned long fw_start;
+	/** Total number of entries ever recorded */
+	unsigned long head;
+	/** Trace entries */
+	struct sbi_trace_entry entries[];
+};
+
+struct sbi_scratch;
+
+void sbi_trace_log(const char *fmt, unsigned long a0, unsigned long a1,
+		   unsigned long a2, unsigned long a3);
+
+#define __sbi_trace(__fmt, __a0, __a1, __a2, __a3, ...)			\
+	sbi_trace_log(__fmt, (unsigned long)(__a0), (unsigned long)(__a1), \
+		      (unsigned long)(__a2), (unsigned long)(__a3))
+
+#ifdef CONFIG_SBI_TRACE
+
+/**
+ * Record a trace entry on the current HART
+ *
+ * Takes a string literal format and at most four integer arguments.
+ * Nothing is formatted at run-time so this is cheap enough for hot paths.
+ */
+#define sbi_trace(__fmt, ...)						\
+	__sbi_trace(__fmt, ##__VA_ARGS__, 0, 0, 0, 0, 0)
+
+/** Print all trace rings as hex records on the console */
+void sbi_trace_dump(void);
+
+/** Discard all recorded trace entries */
+void sbi_trace_reset(void);
+
+int sbi_trace_init(struct sbi_scratch *scratch, bool cold_boot);
+
+#else
+
+#define sbi_trace(__fmt, ...)						\
+do {									\
+	if (0)								\
+		__sbi_trace(__fmt, ##__VA_ARGS__, 0, 0, 0, 0, 0);	\
+} while (0)
+
+static inline void sbi_trace_dump(void) { }
+
+static inline void sbi_trace_reset(void) { }
+
+static inline int sbi_trace_init(struct sbi_scratch *scratch, bool cold_boot)
+{
+	return 0;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) Nuclei Corporation or its affiliates.
+ */
+
+#ifndef __SBI_TRAP_PROFILE_H__
+#define __SBI_TRAP_PROFILE_H__
+
+#include <sbi/sbi_pmu.h>
+#include <sbi/sbi_types.h>
+
+/** Version of the raw trap profile table layout */
+#define SBI_TRAP_PROFILE_VERSION	1
+
+#define SBI_TRAP_PROFILE_EXC_MAX	32
+#define SBI_TRAP_PROFILE_IRQ_MAX	16
+#define SBI_TRAP_PROFILE_ECALL_MAX	32
+#define SBI_TRAP_PROFILE_CSR_MAX	16
+
+/*
+ * Event data of SBI_PMU_FW_PLATFORM events backed by the trap profile
+ *
+ * [31:16] SBI_TRAP_PROFILE_EDATA_TAG
+ * [15:12] class (total, exception or interrupt)
+ * [11:8]  metric (count or M-mode cycles)
+ * [7:0]   mcause code for exception and interrupt classes
+ */
+#define SBI_TRAP_PROFILE_EDATA_TAG		0x5450
+#define SBI_TRAP_PROFILE_EDATA_TAG_SHIFT	SBI_PMU_FW_SOURCE_TAG_SHIFT
+#define SBI_TRAP_PROFILE_EDATA_CLASS_SHIFT	12
+#define SBI_TRAP_PROFILE_EDATA_METRIC_SHIFT	8
+#define SBI_TRAP_PROFILE_EDATA_CAUSE_MASK	0xff
+
+enum sbi_trap_profile_class {
+	SBI_TRAP_PROFILE_CLASS_TOTAL = 0,
+	SBI_TRAP_PROFILE_CLASS_EXC,
+	SBI_TRAP_PROFILE_CLASS_IRQ,
+	SBI_TRAP_PROFILE_CLASS_MAX,
+};
+
+enum sbi_trap_profile_metric {
+	SBI_TRAP_PROFILE_METRIC_COUNT = 0,
+	SBI_TRAP_PROFILE_METRIC_CYCLES,
+	SBI_TRAP_PROFILE_METRIC_MAX,
+};
+
+#define SBI_TRAP_PROFILE_EDATA(__class, __metric, __cause)		\
+	(((u64)SBI_TRAP_PROFILE_EDATA_TAG <<				\
+	  SBI_TRAP_PROFILE_EDATA_TAG_SHIFT) |				\
+	 ((u64)(__class) << SBI_TRAP_PROFILE_EDATA_CLASS_SHIFT) |	\
+	 ((u64)(__metric) << SBI_TRAP_PROFILE_EDATA_METRIC_SHIFT) |	\
+	 ((u64)(__cause) & SBI_TRAP_PROFILE_EDATA_CAUSE_MASK))
+
+struct sbi_trap_profile_stat {
+	/** Number of traps */
+	u64 count;
+	/** M-mode cycles spent handling them */
+	u64 cycles;
+};
+
+struct sbi_trap_profile_ecall {
+	u32 extid;
+	u32 funcid;
+	struct sbi_trap_profile_stat stat;
+};
+
+struct sbi_trap_profile_csr {
+	u32 csr;
+	u32 reserved;
+	struct sbi_trap_profile_stat stat;
+};
+
+/**
+ * Per-HART trap profile
+ *
+ * This is also the layout copied to the supervisor by the firmware
+ * diagnostics extension so fields are only ever appended.
+ */
+struct sbi_trap_profile {
+	u32 version;
+	u32 hartid;
+	/** All traps handled in C */
+	struct sbi_trap_profile_stat total;
+	/** Synchronous exceptions indexed by mcause, last entry for others */
+	struct sbi_trap_profile_stat exc[SBI_TRAP_PROFILE_EXC_MAX];
+	/** Interrupts indexed by mcause code, last entry for others */
+	struct sbi_trap_profile_stat irq[SBI_TRAP_PROFILE_IRQ_MAX];
+	/** Number of valid entries in ecall[] and csr[] */
+	u32 necall;
+	u32 ncsr;
+	/** Ecalls by (EID, FID), ecall_other once the table is full */
+	struct sbi_trap_profile_ecall ecall[SBI_TRAP_PROFILE_ECALL_MAX];
+	struct sbi_trap_profile_stat ecall_other;
+	/** Emulated CSR accesses by CSR number, csr_other once full */
+	struct sbi_trap_profile_csr csr[SBI_TRAP_PROFILE_CSR_MAX];
+	struct sbi_trap_profile_stat csr_other;
+};
+
+struct sbi_domain;
+struct sbi_scratch;
+struct sbi_trap_regs;
+
+#ifdef CONFIG_SBI_TRAP_PROFILE
+
+/**
+ * Account a handled trap to the profile of the current HART
+ *
+ * start is the firmware cycle clock read by sbi_pmu_fw_cycles_begin()
+ * on trap entry, so time spent suspended is excluded as it is for the
+ * firmware overhead PMU events.
+ */
+void sbi_trap_profile_end(unsigned long start, unsigned long mcause,
+			  unsigned long mtval,
+			  const struct sbi_trap_regs *regs);
+
+const struct sbi_trap_profile *sbi_trap_profile_get(u32 hartid);
+
+/** Clear the profiles of the HARTs assigned to a domain */
+void sbi_trap_profile_reset(const struct sbi_domain *dom);
+
+int sbi_trap_profile_init(struct sbi_scratch *scratch, bool cold_boot);
+
+#else
+
+static inline void sbi_trap_profile_end(unsigned long start,
+					unsigned long mcause,
+					unsigned long mtval,
+					const struct sbi_trap_regs *regs) { }
+
+static inline const struct sbi_trap_profile *sbi_trap_profile_get(u32 hartid)
+{
+	return NULL;
+}
+
+static inline void sbi_trap_profile_reset(const struct sbi_domain *dom) { }
+
+static inline int sbi_trap_profile_init(struct sbi_scratch *scratch,
+					bool cold_boot)
+{
+	return 0;
+}
+
+#endif
+
+#endif
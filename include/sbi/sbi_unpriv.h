@@ -38,4 +38,18 @@ DECLARE_UNPRIVILEGED_LOAD_FUNCTION(ulong)
 
 ulong sbi_get_insn(ulong mepc, struct sbi_trap_info *trap);
 
+/**
+ * Copy len bytes from unprivileged memory
+ *
+ * Aligned parts are copied a word at a time with a single MPRV window per
+ * batch of words. On a trap, trap->cause is set and the number of bytes
+ * copied before the faulting access is returned.
+ */
+ulong sbi_copy_from_unpriv(void *dst, const void *src, ulong len,
+			   struct sbi_trap_info *trap);
+
+/** Copy len bytes to unprivileged memory, see sbi_copy_from_unpriv() */
+ulong sbi_copy_to_unpriv(void *dst, const void *src, ulong len,
+			 struct sbi_trap_info *trap);
+
 #endif
@@ -33,6 +33,14 @@ void plic_context_restore(const struct plic_data *plic, int context_id,
 int plic_context_init(const struct plic_data *plic, int context_id,
 		      bool enable, u32 threshold);
 
+int plic_context_enable_irq(const struct plic_data *plic, int context_id,
+			    u32 hwirq, u32 priority);
+
+u32 plic_context_claim(const struct plic_data *plic, int context_id);
+
+void plic_context_complete(const struct plic_data *plic, int context_id,
+			   u32 hwirq);
+
 int plic_warm_irqchip_init(const struct plic_data *plic,
 			   int m_cntx_id, int s_cntx_id);
 
@@ -5,8 +5,107 @@
  * Copyright (c) 2021 Christoph Müllner <cmuellner@linux.com>
  */
 
+#include <sbi/riscv_asm.h>
 #include <sbi/riscv_barrier.h>
+#include <sbi/riscv_encoding.h>
 #include <sbi/riscv_locks.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_scratch.h>
+
+#ifdef CONFIG_SBI_LOCK_STATS
+
+/* Maximum number of locks tracked in the statistics table */
+#define SPIN_LOCK_STATS_MAX	64
+
+static struct spin_lock_stats *lock_stats_table[SPIN_LOCK_STATS_MAX];
+static unsigned long lock_stats_count;
+
+static void spin_lock_stats_register(struct spin_lock_stats *st)
+{
+	unsigned long i, count;
+
+	/*
+	 * Called with the lock held so only one HART at a time can
+	 * register a particular lock. A lock initialized again after
+	 * registration is already in the table so look it up first.
+	 */
+	count = __smp_load_acquire(&lock_stats_count);
+	for (i = 0; i < count && i < SPIN_LOCK_STATS_MAX; i++) {
+		if (lock_stats_table[i] == st)
+			goto done;
+	}
+
+	i = __atomic_fetch_add(&lock_stats_count, 1, __ATOMIC_ACQ_REL);
+	if (i < SPIN_LOCK_STATS_MAX)
+		__smp_store_release(&lock_stats_table[i], st);
+
+done:
+	st->registered = 1;
+}
+
+static void spin_lock_stats_update(struct spin_lock_stats *st,
+				   unsigned long spins, unsigned long wait)
+{
+	if (!st->registered)
+		spin_lock_stats_register(st);
+
+	st->acquired++;
+	if (!spins)
+		return;
+
+	st->contended++;
+	st->spins += spins;
+	st->wait_cycles += wait;
+	if (st->max_wait_cycles < wait)
+		st->max_wait_cycles = wait;
+}
+
+void spin_lock_stats_dump(void)
+{
+	struct spin_lock_stats *st;
+	unsigned long i, count;
+
+	count = __smp_load_acquire(&lock_stats_count);
+	if (SPIN_LOCK_STATS_MAX < count)
+		count = SPIN_LOCK_STATS_MAX;
+
+	sbi_printf("%-24s %12s %12s %12s %12s %12s\n", "Lock", "Acquired",
+		   "Contended", "Spins", "WaitCycles", "MaxWait");
+	for (i = 0; i < count; i++) {
+		st = __smp_load_acquire(&lock_stats_table[i]);
+		if (!st)
+			continue;
+		sbi_printf("%-24s %12lu %12lu %12lu %12lu %12lu\n",
+			   (st->name) ? st->name : "(unnamed)",
+			   st->acquired, st->contended, st->spins,
+			   st->wait_cycles, st->max_wait_cycles);
+	}
+}
+
+void spin_lock_stats_reset(void)
+{
+	struct spin_lock_stats *st;
+	unsigned long i, count;
+
+	count = __smp_load_acquire(&lock_stats_count);
+	if (SPIN_LOCK_STATS_MAX < count)
+		count = SPIN_LOCK_STATS_MAX;
+
+	for (i = 0; i < count; i++) {
+		st = __smp_load_acquire(&lock_stats_table[i]);
+		if (!st)
+			continue;
+		st->acquired = 0;
+		st->contended = 0;
+		st->spins = 0;
+		st->wait_cycles = 0;
+		st->max_wait_cycles = 0;
+	}
+}
+
+#endif
 
 static inline bool spin_lock_unlocked(spinlock_t lock)
 {
@@ -45,7 +144,7 @@ bool spin_trylock(spinlock_t *lock)
 	return l0 == 0;
 }
 
-void spin_lock(spinlock_t *lock)
+static inline void __spin_lock(spinlock_t *lock)
 {
 	unsigned long inc = 1u << TICKET_SHIFT;
 	unsigned long mask = 0xffffu;
@@ -71,7 +170,193 @@ void spin_lock(spinlock_t *lock)
 		: "memory");
 }
 
+#ifdef CONFIG_SBI_LOCK_STATS
+
+/* Take a ticket and wait for it, returning the number of spins */
+static unsigned long spin_lock_count(spinlock_t *lock)
+{
+	unsigned long inc = 1u << TICKET_SHIFT;
+	unsigned long spins = 0;
+	u32 l0;
+
+	__asm__ __volatile__(
+		"	amoadd.w.aqrl	%0, %2, %1\n"
+		: "=&r"(l0), "+A"(*lock)
+		: "r"(inc)
+		: "memory");
+
+	while ((u16)(l0 >> TICKET_SHIFT) !=
+	       *(volatile u16 *)&lock->owner) {
+		spins++;
+		cpu_relax();
+	}
+	RISCV_FENCE(r, rw);
+
+	return spins;
+}
+
+void spin_lock(spinlock_t *lock)
+{
+	unsigned long start, spins;
+
+	if (spin_trylock(lock)) {
+		spin_lock_stats_update(&lock->stats, 0, 0);
+		return;
+	}
+
+	start = csr_read(CSR_MCYCLE);
+	spins = spin_lock_count(lock);
+	spin_lock_stats_update(&lock->stats, spins ? spins : 1,
+			       csr_read(CSR_MCYCLE) - start);
+}
+
+#else
+
+void spin_lock(spinlock_t *lock)
+{
+	__spin_lock(lock);
+}
+
+#endif
+
 void spin_unlock(spinlock_t *lock)
 {
 	__smp_store_release(&lock->owner, lock->owner + 1);
 }
+
+/*
+ * MCS spinlock nodes live in per-HART scratch space. Until the scratch
+ * offset is allocated only the coldboot HART runs so it can safely use
+ * the static boot nodes instead.
+ */
+static unsigned long mcs_node_offset;
+static struct mcs_spinlock_node mcs_boot_nodes[MCS_SPIN_LOCK_MAX_NESTING];
+
+static struct mcs_spinlock_node *mcs_spin_nodes(void)
+{
+	if (!mcs_node_offset)
+		return mcs_boot_nodes;
+
+	return sbi_scratch_thishart_offset_ptr(mcs_node_offset);
+}
+
+static struct mcs_spinlock_node *mcs_spin_node_get(mcs_spinlock_t *lock)
+{
+	struct mcs_spinlock_node *nodes = mcs_spin_nodes();
+	int i;
+
+	for (i = 0; i < MCS_SPIN_LOCK_MAX_NESTING; i++) {
+		if (!nodes[i].lock) {
+			nodes[i].lock = lock;
+			nodes[i].next = NULL;
+			nodes[i].locked = 0;
+			return &nodes[i];
+		}
+	}
+
+	/* Too many MCS spinlocks held by this HART */
+	sbi_hart_hang();
+	return NULL;
+}
+
+static struct mcs_spinlock_node *mcs_spin_node_find(mcs_spinlock_t *lock)
+{
+	struct mcs_spinlock_node *nodes = mcs_spin_nodes();
+	int i;
+
+	for (i = 0; i < MCS_SPIN_LOCK_MAX_NESTING; i++) {
+		if (nodes[i].lock == lock)
+			return &nodes[i];
+	}
+
+	/* Unlocking an MCS spinlock which is not held by this HART */
+	sbi_hart_hang();
+	return NULL;
+}
+
+int mcs_spin_lock_init(void)
+{
+	if (mcs_node_offset)
+		return 0;
+
+	mcs_node_offset = sbi_scratch_alloc_offset(
+			sizeof(struct mcs_spinlock_node) *
+			MCS_SPIN_LOCK_MAX_NESTING);
+	if (!mcs_node_offset)
+		return SBI_ENOMEM;
+
+	return 0;
+}
+
+bool mcs_spin_lock_check(mcs_spinlock_t *lock)
+{
+	return __smp_load_acquire(&lock->tail) != NULL;
+}
+
+bool mcs_spin_trylock(mcs_spinlock_t *lock)
+{
+	struct mcs_spinlock_node *node = mcs_spin_node_get(lock);
+
+	if (__sync_val_compare_and_swap(&lock->tail, NULL, node) == NULL) {
+#ifdef CONFIG_SBI_LOCK_STATS
+		spin_lock_stats_update(&lock->stats, 0, 0);
+#endif
+		return true;
+	}
+
+	node->lock = NULL;
+	return false;
+}
+
+void mcs_spin_lock(mcs_spinlock_t *lock)
+{
+	struct mcs_spinlock_node *node = mcs_spin_node_get(lock);
+	struct mcs_spinlock_node *prev;
+#ifdef CONFIG_SBI_LOCK_STATS
+	unsigned long start = csr_read(CSR_MCYCLE), spins = 0;
+#endif
+
+	/* Atomically enqueue our node at the tail. */
+	prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+	if (prev) {
+		/* Link behind the previous waiter and spin on our node. */
+		__smp_store_release(&prev->next, node);
+		while (!__smp_load_acquire(&node->locked)) {
+#ifdef CONFIG_SBI_LOCK_STATS
+			spins++;
+#endif
+			cpu_relax();
+		}
+	}
+
+#ifdef CONFIG_SBI_LOCK_STATS
+	if (prev)
+		spin_lock_stats_update(&lock->stats, spins ? spins : 1,
+				       csr_read(CSR_MCYCLE) - start);
+	else
+		spin_lock_stats_update(&lock->stats, 0, 0);
+#endif
+}
+
+void mcs_spin_unlock(mcs_spinlock_t *lock)
+{
+	struct mcs_spinlock_node *node = mcs_spin_node_find(lock);
+	struct mcs_spinlock_node *next;
+
+	next = __smp_load_acquire(&node->next);
+	if (!next) {
+		/* No known successor so try to mark the lock free. */
+		if (__sync_val_compare_and_swap(&lock->tail, node, NULL) == node)
+			goto done;
+
+		/* A successor is enqueueing, wait for it to link in. */
+		while (!(next = __smp_load_acquire(&node->next)))
+			cpu_relax();
+	}
+
+	/* Hand over the lock to the successor. */
+	__smp_store_release(&next->locked, 1);
+
+done:
+	node->lock = NULL;
+}
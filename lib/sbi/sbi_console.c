@@ -7,19 +7,69 @@
  *   Anup Patel <anup.patel@wdc.com>
  */
 
+#include <sbi/riscv_barrier.h>
 #include <sbi/riscv_locks.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_hart.h>
+#include <sbi/sbi_heap.h>
 #include <sbi/sbi_platform.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
+#include <sbi/sbi_timer.h>
 
 #define CONSOLE_TBUF_MAX 256
 
 static const struct sbi_console_device *console_dev = NULL;
 static char console_tbuf[CONSOLE_TBUF_MAX];
 static u32 console_tbuf_len;
-static spinlock_t console_out_lock	       = SPIN_LOCK_INITIALIZER;
+static DEFINE_MCS_SPIN_LOCK(console_out_lock);
+
+#ifdef CONFIG_SBI_CONSOLE_ASYNC
+
+#define CONSOLE_RING_SIZE	CONFIG_SBI_CONSOLE_RING_SIZE
+#define CONSOLE_RING_MASK	(CONSOLE_RING_SIZE - 1)
+
+/* Buffered output is flushed at the latest this long after it is queued */
+#define CONSOLE_DRAIN_DELAY_MS	10
+
+_Static_assert((CONSOLE_RING_SIZE & CONSOLE_RING_MASK) == 0,
+	       "CONFIG_SBI_CONSOLE_RING_SIZE must be a power of 2");
+
+/*
+ * Per-HART console log ring. Only the owning HART advances head while
+ * tail is only advanced by the HART draining rings with
+ * console_out_lock held, so producers never take a lock.
+ */
+struct console_ring {
+	unsigned long head;
+	unsigned long tail;
+	u32 tbuf_len;
+	char tbuf[CONSOLE_TBUF_MAX];
+	char buf[CONSOLE_RING_SIZE];
+	struct sbi_timer_event drain_ev;
+};
+
+static unsigned long console_ring_offset;
+static bool console_sync;
+
+static struct console_ring *console_thishart_ring(void)
+{
+	if (!console_ring_offset || console_sync)
+		return NULL;
+
+	return sbi_scratch_read_type(sbi_scratch_thishart_ptr(),
+				     struct console_ring *,
+				     console_ring_offset);
+}
+
+#else
+
+static inline struct console_ring *console_thishart_ring(void)
+{
+	return NULL;
+}
+
+#endif
 
 bool sbi_isprintable(char c)
 {
@@ -30,8 +80,77 @@ bool sbi_isprintable(char c)
 	return false;
 }
 
+#ifdef CONFIG_SBI_CONSOLE_RX_IRQ
+
+#define CONSOLE_RX_RING_SIZE	256
+#define CONSOLE_RX_RING_MASK	(CONSOLE_RX_RING_SIZE - 1)
+
+/*
+ * Characters received by the console RX interrupt are buffered here
+ * so that reads don't touch the console device and nothing is lost
+ * when the device FIFO overflows between reads.
+ */
+static char console_rx_ring[CONSOLE_RX_RING_SIZE];
+static unsigned long console_rx_head;
+static unsigned long console_rx_tail;
+static bool console_rx_irq;
+static DEFINE_SPIN_LOCK(console_in_lock);
+
+void sbi_console_rx_process(void)
+{
+	int ch;
+
+	if (!console_dev || !console_dev->console_getc)
+		return;
+
+	spin_lock(&console_in_lock);
+	while ((ch = console_dev->console_getc()) >= 0) {
+		/* Drop new characters when the ring is full */
+		if (console_rx_head - console_rx_tail < CONSOLE_RX_RING_SIZE)
+			console_rx_ring[console_rx_head++ &
+					CONSOLE_RX_RING_MASK] = ch;
+	}
+	spin_unlock(&console_in_lock);
+}
+
+int sbi_console_rx_irq_enable(void)
+{
+	int rc;
+
+	if (!console_dev || !console_dev->console_rx_irq_enable)
+		return SBI_ENOTSUPP;
+
+	rc = console_dev->console_rx_irq_enable();
+	if (rc)
+		return rc;
+
+	console_rx_irq = true;
+	return 0;
+}
+
+static unsigned long console_rx_gets(char *str, unsigned long len)
+{
+	unsigned long i;
+
+	spin_lock(&console_in_lock);
+	for (i = 0; i < len && console_rx_tail != console_rx_head; i++)
+		str[i] = console_rx_ring[console_rx_tail++ &
+					 CONSOLE_RX_RING_MASK];
+	spin_unlock(&console_in_lock);
+
+	return i;
+}
+
+#endif
+
 int sbi_getc(void)
 {
+#ifdef CONFIG_SBI_CONSOLE_RX_IRQ
+	char ch;
+
+	if (console_rx_irq)
+		return console_rx_gets(&ch, 1) ? (unsigned char)ch : -1;
+#endif
 	if (console_dev && console_dev->console_getc)
 		return console_dev->console_getc();
 	return -1;
@@ -63,27 +182,180 @@ static void nputs_all(const char *str, unsigned long len)
 		p += nputs(&str[p], len - p);
 }
 
+#ifdef CONFIG_SBI_CONSOLE_ASYNC
+
+/* Must be called with console_out_lock held */
+static void console_ring_drain(struct console_ring *ring)
+{
+	unsigned long off, n, tail = ring->tail;
+	unsigned long head = __smp_load_acquire(&ring->head);
+
+	while (tail != head) {
+		off = tail & CONSOLE_RING_MASK;
+		n = head - tail;
+		if (CONSOLE_RING_SIZE - off < n)
+			n = CONSOLE_RING_SIZE - off;
+		nputs_all(&ring->buf[off], n);
+		tail += n;
+		__smp_store_release(&ring->tail, tail);
+	}
+}
+
+/* Must be called with console_out_lock held */
+static void console_ring_drain_all(void)
+{
+	struct console_ring *ring;
+	struct sbi_scratch *scratch;
+	u32 i;
+
+	if (!console_ring_offset)
+		return;
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		scratch = sbi_hartindex_to_scratch(i);
+		if (!scratch)
+			continue;
+		ring = sbi_scratch_read_type(scratch, struct console_ring *,
+					     console_ring_offset);
+		if (ring)
+			console_ring_drain(ring);
+	}
+}
+
+static bool console_ring_put(struct console_ring *ring,
+			     const char *str, unsigned long len)
+{
+	unsigned long i, head = ring->head;
+	unsigned long tail = __smp_load_acquire(&ring->tail);
+
+	if (CONSOLE_RING_SIZE - (head - tail) < len)
+		return false;
+
+	for (i = 0; i < len; i++)
+		ring->buf[(head + i) & CONSOLE_RING_MASK] = str[i];
+	__smp_store_release(&ring->head, head + len);
+
+	return true;
+}
+
+static void console_drain_timeout(struct sbi_timer_event *ev)
+{
+	sbi_console_flush();
+}
+
+/* Arm the drain timer of the current HART unless already pending */
+static void console_drain_schedule(struct console_ring *ring)
+{
+	const struct sbi_timer_device *tdev = sbi_timer_get_device();
+
+	if (!tdev || sbi_timer_event_pending(&ring->drain_ev))
+		return;
+
+	ring->drain_ev.callback = console_drain_timeout;
+	sbi_timer_event_add(&ring->drain_ev, sbi_timer_value() +
+			    (tdev->timer_freq / 1000) * CONSOLE_DRAIN_DELAY_MS);
+}
+
+static void console_write(const char *str, unsigned long len)
+{
+	struct console_ring *ring = console_thishart_ring();
+
+	if (ring) {
+		if (console_ring_put(ring, str, len)) {
+			console_drain_schedule(ring);
+			return;
+		}
+
+		/* Ring is full so drain synchronously and try again */
+		sbi_console_flush();
+		if (console_ring_put(ring, str, len))
+			return;
+
+		mcs_spin_lock(&console_out_lock);
+		console_ring_drain(ring);
+		nputs_all(str, len);
+		mcs_spin_unlock(&console_out_lock);
+		return;
+	}
+
+	nputs_all(str, len);
+}
+
+void sbi_console_flush(void)
+{
+	if (!console_ring_offset)
+		return;
+
+	mcs_spin_lock(&console_out_lock);
+	console_ring_drain_all();
+	mcs_spin_unlock(&console_out_lock);
+}
+
+void sbi_console_sync(void)
+{
+	/* Also stops recursion when the flush below hangs this HART */
+	if (console_sync)
+		return;
+
+	console_sync = true;
+	sbi_console_flush();
+}
+
+#else
+
+static inline void console_ring_drain_all(void)
+{
+}
+
+static inline void console_write(const char *str, unsigned long len)
+{
+	nputs_all(str, len);
+}
+
+#endif
+
+/*
+ * Output goes to the per-HART log ring when one is available and
+ * directly to the console device under console_out_lock otherwise.
+ */
+static bool console_out_begin(void)
+{
+	if (console_thishart_ring())
+		return true;
+
+	mcs_spin_lock(&console_out_lock);
+	return false;
+}
+
+static void console_out_end(bool buffered)
+{
+	if (!buffered)
+		mcs_spin_unlock(&console_out_lock);
+}
+
 void sbi_putc(char ch)
 {
+	sbi_console_flush();
 	nputs_all(&ch, 1);
 }
 
 void sbi_puts(const char *str)
 {
 	unsigned long len = sbi_strlen(str);
+	bool buffered = console_out_begin();
 
-	spin_lock(&console_out_lock);
-	nputs_all(str, len);
-	spin_unlock(&console_out_lock);
+	console_write(str, len);
+	console_out_end(buffered);
 }
 
 unsigned long sbi_nputs(const char *str, unsigned long len)
 {
 	unsigned long ret;
 
-	spin_lock(&console_out_lock);
+	mcs_spin_lock(&console_out_lock);
+	console_ring_drain_all();
 	ret = nputs(str, len);
-	spin_unlock(&console_out_lock);
+	mcs_spin_unlock(&console_out_lock);
 
 	return ret;
 }
@@ -106,6 +378,11 @@ unsigned long sbi_ngets(char *str, unsigned long len)
 	int ch;
 	unsigned long i;
 
+#ifdef CONFIG_SBI_CONSOLE_RX_IRQ
+	if (console_rx_irq)
+		return console_rx_gets(str, len);
+#endif
+
 	for (i = 0; i < len; i++) {
 		ch = sbi_getc();
 		if (ch < 0)
@@ -145,8 +422,8 @@ static void printc(char **out, u32 *out_len, char ch, int flags)
 		if (out_len) {
 			--(*out_len);
 			if ((flags & USE_TBUF) && *out_len == 1) {
-				nputs_all(console_tbuf, CONSOLE_TBUF_MAX - *out_len);
-				*out = console_tbuf;
+				*out -= CONSOLE_TBUF_MAX - *out_len;
+				console_write(*out, CONSOLE_TBUF_MAX - *out_len);
 				*out_len = CONSOLE_TBUF_MAX;
 			}
 		}
@@ -255,19 +532,30 @@ static int print(char **out, u32 *out_len, const char *format, va_list args)
 {
 	bool flags_done;
 	int width, flags, pc = 0;
-	char type, scr[2], *tout;
+	char type, scr[2], *tbuf = NULL, *tout;
 	bool use_tbuf = (!out) ? true : false;
+	struct console_ring *ring = console_thishart_ring();
 
 	/*
 	 * The console_tbuf is protected by console_out_lock and
 	 * print() is always called with console_out_lock held
-	 * when out == NULL.
+	 * when out == NULL and output is not buffered in the per-HART
+	 * log ring, which has its own tbuf.
 	 */
 	if (use_tbuf) {
-		console_tbuf_len = CONSOLE_TBUF_MAX;
-		tout = console_tbuf;
+#ifdef CONFIG_SBI_CONSOLE_ASYNC
+		if (ring) {
+			tbuf = ring->tbuf;
+			out_len = &ring->tbuf_len;
+		}
+#endif
+		if (!ring) {
+			tbuf = console_tbuf;
+			out_len = &console_tbuf_len;
+		}
+		*out_len = CONSOLE_TBUF_MAX;
+		tout = tbuf;
 		out = &tout;
-		out_len = &console_tbuf_len;
 	}
 
 	/* handle special case: *out_len == 1*/
@@ -384,8 +672,8 @@ literal:
 		}
 	}
 
-	if (use_tbuf && console_tbuf_len < CONSOLE_TBUF_MAX)
-		nputs_all(console_tbuf, CONSOLE_TBUF_MAX - console_tbuf_len);
+	if (use_tbuf && *out_len < CONSOLE_TBUF_MAX)
+		console_write(tbuf, CONSOLE_TBUF_MAX - *out_len);
 
 	return pc;
 }
@@ -425,12 +713,12 @@ int sbi_printf(const char *format, ...)
 {
 	va_list args;
 	int retval;
+	bool buffered = console_out_begin();
 
-	spin_lock(&console_out_lock);
 	va_start(args, format);
 	retval = print(NULL, NULL, format, args);
 	va_end(args);
-	spin_unlock(&console_out_lock);
+	console_out_end(buffered);
 
 	return retval;
 }
@@ -439,13 +727,14 @@ int sbi_dprintf(const char *format, ...)
 {
 	va_list args;
 	int retval = 0;
+	bool buffered;
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
 
 	va_start(args, format);
 	if (scratch->options & SBI_SCRATCH_DEBUG_PRINTS) {
-		spin_lock(&console_out_lock);
+		buffered = console_out_begin();
 		retval = print(NULL, NULL, format, args);
-		spin_unlock(&console_out_lock);
+		console_out_end(buffered);
 	}
 	va_end(args);
 
@@ -456,11 +745,14 @@ void sbi_panic(const char *format, ...)
 {
 	va_list args;
 
-	spin_lock(&console_out_lock);
+	/* Drain buffered output and print synchronously from now on */
+	sbi_console_sync();
+
+	mcs_spin_lock(&console_out_lock);
 	va_start(args, format);
 	print(NULL, NULL, format, args);
 	va_end(args);
-	spin_unlock(&console_out_lock);
+	mcs_spin_unlock(&console_out_lock);
 
 	sbi_hart_hang();
 }
@@ -478,6 +770,34 @@ void sbi_console_set_device(const struct sbi_console_device *dev)
 	console_dev = dev;
 }
 
+#ifdef CONFIG_SBI_CONSOLE_ASYNC
+
+static void console_ring_init(void)
+{
+	struct console_ring *ring;
+	struct sbi_scratch *scratch;
+	unsigned long offset;
+	u32 i;
+
+	offset = sbi_scratch_alloc_type_offset(struct console_ring *);
+	if (!offset)
+		return;
+
+	/* Without a ring a HART simply keeps printing synchronously */
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		scratch = sbi_hartindex_to_scratch(i);
+		if (!scratch)
+			continue;
+		ring = sbi_zalloc(sizeof(*ring));
+		sbi_scratch_write_type(scratch, struct console_ring *,
+				       offset, ring);
+	}
+
+	__smp_store_release(&console_ring_offset, offset);
+}
+
+#endif
+
 int sbi_console_init(struct sbi_scratch *scratch)
 {
 	int rc = sbi_platform_console_init(sbi_platform_ptr(scratch));
@@ -486,5 +806,10 @@ int sbi_console_init(struct sbi_scratch *scratch)
 	if (rc == SBI_ENODEV)
 		return 0;
 
+#ifdef CONFIG_SBI_CONSOLE_ASYNC
+	if (!rc)
+		console_ring_init();
+#endif
+
 	return rc;
 }
@@ -11,7 +11,9 @@
 #include <sbi/sbi_ecall.h>
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_error.h>
+#include <sbi/sbi_pmu.h>
 #include <sbi/sbi_trap.h>
+#include <sbi/sbi_trap_profile.h>
 
 extern struct sbi_ecall_extension *sbi_ecall_exts[];
 extern unsigned long sbi_ecall_exts_size;
@@ -40,9 +42,101 @@ void sbi_ecall_set_impid(unsigned long impid)
 
 static SBI_LIST_HEAD(ecall_exts_list);
 
+/*
+ * Lookup tables rebuilt from ecall_exts_list whenever an extension is
+ * registered or unregistered. Extensions covering a single EID go into
+ * an open addressed hash table and the few covering a range of EIDs go
+ * into a table sorted by extid_start. If either table overflows we fall
+ * back to walking the list.
+ */
+#define ECALL_EXT_HASH_BITS	6
+#define ECALL_EXT_HASH_SIZE	(1UL << ECALL_EXT_HASH_BITS)
+#define ECALL_EXT_HASH_MASK	(ECALL_EXT_HASH_SIZE - 1)
+#define ECALL_EXT_HASH_MAX	(ECALL_EXT_HASH_SIZE / 2)
+#define ECALL_EXT_RANGE_MAX	16
+
+static struct sbi_ecall_extension *ecall_ext_hash[ECALL_EXT_HASH_SIZE];
+static struct sbi_ecall_extension *ecall_ext_ranges[ECALL_EXT_RANGE_MAX];
+static unsigned long ecall_ext_nranges;
+static bool ecall_ext_tables_valid;
+
+static inline unsigned long ecall_ext_hash_index(unsigned long extid)
+{
+	/* Fibonacci hashing spreads the ASCII encoded standard EIDs well */
+	return ((u32)extid * 0x9E3779B9U) >> (32 - ECALL_EXT_HASH_BITS);
+}
+
+static void ecall_ext_tables_rebuild(void)
+{
+	struct sbi_ecall_extension *t;
+	unsigned long i, j, nhash = 0;
+
+	ecall_ext_tables_valid = false;
+	ecall_ext_nranges = 0;
+	for (i = 0; i < ECALL_EXT_HASH_SIZE; i++)
+		ecall_ext_hash[i] = NULL;
+
+	sbi_list_for_each_entry(t, &ecall_exts_list, head) {
+		if (t->extid_start == t->extid_end) {
+			if (nhash == ECALL_EXT_HASH_MAX)
+				return;
+			i = ecall_ext_hash_index(t->extid_start);
+			while (ecall_ext_hash[i])
+				i = (i + 1) & ECALL_EXT_HASH_MASK;
+			ecall_ext_hash[i] = t;
+			nhash++;
+			continue;
+		}
+
+		if (ecall_ext_nranges == ECALL_EXT_RANGE_MAX)
+			return;
+		j = ecall_ext_nranges++;
+		while (j &&
+		       ecall_ext_ranges[j - 1]->extid_start > t->extid_start) {
+			ecall_ext_ranges[j] = ecall_ext_ranges[j - 1];
+			j--;
+		}
+		ecall_ext_ranges[j] = t;
+	}
+
+	ecall_ext_tables_valid = true;
+}
+
+static struct sbi_ecall_extension *ecall_ext_range_find(unsigned long extid)
+{
+	struct sbi_ecall_extension *t;
+	unsigned long lo = 0, hi = ecall_ext_nranges, mid;
+
+	/* Ranges never overlap so find the last one starting at or below */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (ecall_ext_ranges[mid]->extid_start <= extid)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (!lo)
+		return NULL;
+
+	t = ecall_ext_ranges[lo - 1];
+	return (extid <= t->extid_end) ? t : NULL;
+}
+
 struct sbi_ecall_extension *sbi_ecall_find_extension(unsigned long extid)
 {
 	struct sbi_ecall_extension *t, *ret = NULL;
+	unsigned long i;
+
+	if (ecall_ext_tables_valid) {
+		/* The table is at most half full so probing terminates */
+		i = ecall_ext_hash_index(extid);
+		while ((t = ecall_ext_hash[i])) {
+			if (t->extid_start == extid)
+				return t;
+			i = (i + 1) & ECALL_EXT_HASH_MASK;
+		}
+		return ecall_ext_range_find(extid);
+	}
 
 	sbi_list_for_each_entry(t, &ecall_exts_list, head) {
 		if (t->extid_start <= extid && extid <= t->extid_end) {
@@ -54,6 +148,43 @@ struct sbi_ecall_extension *sbi_ecall_find_extension(unsigned long extid)
 	return ret;
 }
 
+#ifdef CONFIG_SBI_ECALL_FASTPATH
+
+struct ecall_fast_call {
+	unsigned long extid;
+	unsigned long funcid;
+	struct sbi_ecall_extension *ext;
+};
+
+/*
+ * Calls handled by sbi_ecall_fast_handler(). They must only use argument
+ * registers and never redirect a trap back to S-mode because the trap
+ * entry saves only caller-saved registers for them.
+ */
+static struct ecall_fast_call ecall_fast_calls[] = {
+	{ SBI_EXT_TIME, SBI_EXT_TIME_SET_TIMER },
+	{ SBI_EXT_IPI, SBI_EXT_IPI_SEND_IPI },
+	{ SBI_EXT_RFENCE, SBI_EXT_RFENCE_REMOTE_FENCE_I },
+	{ SBI_EXT_RFENCE, SBI_EXT_RFENCE_REMOTE_SFENCE_VMA },
+	{ SBI_EXT_RFENCE, SBI_EXT_RFENCE_REMOTE_SFENCE_VMA_ASID },
+	{ SBI_EXT_PMU, SBI_EXT_PMU_COUNTER_FW_READ },
+};
+
+static void ecall_fast_calls_update(void)
+{
+	unsigned long i;
+
+	for (i = 0; i < array_size(ecall_fast_calls); i++)
+		ecall_fast_calls[i].ext =
+			sbi_ecall_find_extension(ecall_fast_calls[i].extid);
+}
+
+#else
+
+static inline void ecall_fast_calls_update(void) { }
+
+#endif
+
 int sbi_ecall_register_extension(struct sbi_ecall_extension *ext)
 {
 	struct sbi_ecall_extension *t;
@@ -72,6 +203,8 @@ int sbi_ecall_register_extension(struct sbi_ecall_extension *ext)
 
 	SBI_INIT_LIST_HEAD(&ext->head);
 	sbi_list_add_tail(&ext->head, &ecall_exts_list);
+	ecall_ext_tables_rebuild();
+	ecall_fast_calls_update();
 
 	return 0;
 }
@@ -91,8 +224,42 @@ void sbi_ecall_unregister_extension(struct sbi_ecall_extension *ext)
 		}
 	}
 
-	if (found)
+	if (found) {
 		sbi_list_del_init(&ext->head);
+		ecall_ext_tables_rebuild();
+		ecall_fast_calls_update();
+	}
+}
+
+static void ecall_update_regs(struct sbi_trap_regs *regs,
+			      unsigned long extension_id,
+			      unsigned long func_id, int ret,
+			      struct sbi_ecall_return *out, bool is_0_1_spec)
+{
+	if (out->skip_regs_update)
+		return;
+
+	if (ret < SBI_LAST_ERR ||
+	    (extension_id != SBI_EXT_0_1_CONSOLE_GETCHAR &&
+	     SBI_SUCCESS < ret)) {
+		sbi_printf("%s: Invalid error %d for ext=0x%lx "
+			   "func=0x%lx\n", __func__, ret,
+			   extension_id, func_id);
+		ret = SBI_ERR_FAILED;
+	}
+
+	/*
+	 * This function should return non-zero value only in case of
+	 * fatal error. However, there is no good way to distinguish
+	 * between a fatal and non-fatal errors yet. That's why we treat
+	 * every return value except ETRAP as non-fatal and just return
+	 * accordingly for now. Once fatal errors are defined, that
+	 * case should be handled differently.
+	 */
+	regs->mepc += 4;
+	regs->a0 = ret;
+	if (!is_0_1_spec)
+		regs->a1 = out->value;
 }
 
 int sbi_ecall_handler(struct sbi_trap_regs *regs)
@@ -114,33 +281,46 @@ int sbi_ecall_handler(struct sbi_trap_regs *regs)
 		ret = SBI_ENOTSUPP;
 	}
 
-	if (!out.skip_regs_update) {
-		if (ret < SBI_LAST_ERR ||
-		    (extension_id != SBI_EXT_0_1_CONSOLE_GETCHAR &&
-		     SBI_SUCCESS < ret)) {
-			sbi_printf("%s: Invalid error %d for ext=0x%lx "
-				   "func=0x%lx\n", __func__, ret,
-				   extension_id, func_id);
-			ret = SBI_ERR_FAILED;
-		}
+	ecall_update_regs(regs, extension_id, func_id, ret, &out, is_0_1_spec);
+
+	return 0;
+}
+
+#ifdef CONFIG_SBI_ECALL_FASTPATH
+
+/*
+ * Called from the trap entry for S-mode ecalls before the full register
+ * state is saved. Only caller-saved registers, MEPC and MSTATUS are valid
+ * in regs. Returns false to continue with the regular trap handler.
+ */
+bool sbi_ecall_fast_handler(struct sbi_trap_regs *regs)
+{
+	int ret;
+	unsigned long i, fwcyc = sbi_pmu_fw_cycles_begin();
+	struct ecall_fast_call *fc;
+	struct sbi_ecall_return out = {0};
+
+	for (i = 0; i < array_size(ecall_fast_calls); i++) {
+		fc = &ecall_fast_calls[i];
+		if (fc->funcid != regs->a6 || fc->extid != regs->a7)
+			continue;
+		if (!fc->ext)
+			return false;
 
-		/*
-		 * This function should return non-zero value only in case of
-		 * fatal error. However, there is no good way to distinguish
-		 * between a fatal and non-fatal errors yet. That's why we treat
-		 * every return value except ETRAP as non-fatal and just return
-		 * accordingly for now. Once fatal errors are defined, that
-		 * case should be handled differently.
-		 */
-		regs->mepc += 4;
-		regs->a0 = ret;
-		if (!is_0_1_spec)
-			regs->a1 = out.value;
+		ret = fc->ext->handle(fc->extid, fc->funcid, regs, &out);
+		ecall_update_regs(regs, fc->extid, fc->funcid, ret, &out,
+				  false);
+		sbi_trap_profile_end(fwcyc, CAUSE_SUPERVISOR_ECALL, 0, regs);
+		sbi_pmu_fw_cycles_end(SBI_PMU_FW_CYCLES_ECALL, fwcyc);
+		sbi_pmu_fw_cycles_end(SBI_PMU_FW_CYCLES_TOTAL, fwcyc);
+		return true;
 	}
 
-	return 0;
+	return false;
 }
 
+#endif
+
 int sbi_ecall_init(void)
 {
 	int ret;
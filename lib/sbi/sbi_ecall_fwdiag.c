@@ -0,0 +1,155 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) Nuclei Corporation or its affiliates.
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_locks.h>
+#include <sbi/sbi_bitops.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_ecall.h>
+#include <sbi/sbi_ecall_interface.h>
+#include <sbi/sbi_hart.h>
+#include <sbi/sbi_pmu.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_trace.h>
+#include <sbi/sbi_trap.h>
+#include <sbi/sbi_trap_profile.h>
+
+#ifdef CONFIG_SBI_TRAP_PROFILE
+static int fwdiag_trap_profile_read(struct sbi_trap_regs *regs,
+				    struct sbi_ecall_return *out)
+{
+	ulong smode = (csr_read(CSR_MSTATUS) & MSTATUS_MPP) >>
+			MSTATUS_MPP_SHIFT;
+	const struct sbi_domain *dom = sbi_domain_thishart_ptr();
+	const struct sbi_trap_profile *tp;
+	unsigned long size = regs->a3;
+
+	/* Profiles of HARTs in other domains are not visible */
+	if (!sbi_domain_is_assigned_hart(dom, regs->a0))
+		return SBI_ERR_INVALID_PARAM;
+
+	tp = sbi_trap_profile_get(regs->a0);
+	if (!tp)
+		return SBI_ERR_INVALID_PARAM;
+
+	/* Same physical address rules as the DBCN extension */
+	if (regs->a2)
+		return SBI_ERR_FAILED;
+
+	if (size > sizeof(*tp))
+		size = sizeof(*tp);
+	if (size) {
+		if (!sbi_domain_check_addr_range(dom, regs->a1, size, smode,
+					SBI_DOMAIN_READ|SBI_DOMAIN_WRITE))
+			return SBI_ERR_INVALID_PARAM;
+		sbi_hart_map_saddr(regs->a1, size);
+		sbi_memcpy((void *)regs->a1, tp, size);
+		sbi_hart_unmap_saddr();
+	}
+
+	/* Always report the full table size so callers can size buffers */
+	out->value = sizeof(*tp);
+	return 0;
+}
+#endif
+
+/*
+ * Read the counters cbase + i for every bit i set in cmask into the 64-bit
+ * slot i of the buffer. Counters which can't be read through
+ * COUNTER_FW_READ are left zero and cleared from the returned mask.
+ */
+static int fwdiag_pmu_counters_read(struct sbi_trap_regs *regs,
+				    struct sbi_ecall_return *out)
+{
+	ulong smode = (csr_read(CSR_MSTATUS) & MSTATUS_MPP) >>
+			MSTATUS_MPP_SHIFT;
+	unsigned long cbase = regs->a0, cmask = regs->a1, done = 0;
+	unsigned long size;
+	uint64_t *vals;
+	int i;
+
+	if (!cmask || (cbase + sbi_fls(cmask)) >= sbi_pmu_num_ctr())
+		return SBI_ERR_INVALID_PARAM;
+
+	/* Same physical address rules as the DBCN extension */
+	if (regs->a3)
+		return SBI_ERR_FAILED;
+
+	size = (sbi_fls(cmask) + 1) * sizeof(*vals);
+	if (regs->a2 & (sizeof(*vals) - 1) ||
+	    !sbi_domain_check_addr_range(sbi_domain_thishart_ptr(),
+					 regs->a2, size, smode,
+					 SBI_DOMAIN_READ|SBI_DOMAIN_WRITE))
+		return SBI_ERR_INVALID_PARAM;
+
+	vals = (uint64_t *)regs->a2;
+	sbi_hart_map_saddr(regs->a2, size);
+	for (i = 0; i <= sbi_fls(cmask); i++) {
+		if (!(cmask & BIT(i)))
+			continue;
+		if (sbi_pmu_ctr_fw_read(cbase + i, &vals[i])) {
+			vals[i] = 0;
+			continue;
+		}
+		done |= BIT(i);
+	}
+	sbi_hart_unmap_saddr();
+
+	out->value = done;
+	return 0;
+}
+
+static int sbi_ecall_fwdiag_handler(unsigned long extid, unsigned long funcid,
+				    struct sbi_trap_regs *regs,
+				    struct sbi_ecall_return *out)
+{
+	switch (funcid) {
+#ifdef CONFIG_SBI_LOCK_STATS
+	case SBI_EXT_FWDIAG_LOCK_STATS_DUMP:
+		spin_lock_stats_dump();
+		return 0;
+	case SBI_EXT_FWDIAG_LOCK_STATS_RESET:
+		spin_lock_stats_reset();
+		return 0;
+#endif
+#ifdef CONFIG_SBI_TRACE
+	case SBI_EXT_FWDIAG_TRACE_DUMP:
+		sbi_trace_dump();
+		return 0;
+	case SBI_EXT_FWDIAG_TRACE_RESET:
+		sbi_trace_reset();
+		return 0;
+#endif
+#ifdef CONFIG_SBI_TRAP_PROFILE
+	case SBI_EXT_FWDIAG_TRAP_PROFILE_READ:
+		return fwdiag_trap_profile_read(regs, out);
+	case SBI_EXT_FWDIAG_TRAP_PROFILE_RESET:
+		sbi_trap_profile_reset(sbi_domain_thishart_ptr());
+		return 0;
+#endif
+	case SBI_EXT_FWDIAG_PMU_COUNTERS_READ:
+		return fwdiag_pmu_counters_read(regs, out);
+	default:
+		break;
+	}
+
+	return SBI_ENOTSUPP;
+}
+
+struct sbi_ecall_extension ecall_fwdiag;
+
+static int sbi_ecall_fwdiag_register_extensions(void)
+{
+	return sbi_ecall_register_extension(&ecall_fwdiag);
+}
+
+struct sbi_ecall_extension ecall_fwdiag = {
+	.extid_start		= SBI_EXT_FWDIAG,
+	.extid_end		= SBI_EXT_FWDIAG,
+	.register_extensions	= sbi_ecall_fwdiag_register_extensions,
+	.handle			= sbi_ecall_fwdiag_handler,
+};
@@ -7,6 +7,7 @@
  *   Atish Patra <atish.patra@wdc.com>
  */
 
+#include <sbi/sbi_bitops.h>
 #include <sbi/sbi_ecall.h>
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_error.h>
@@ -74,7 +75,10 @@ static int sbi_ecall_pmu_handler(unsigned long extid, unsigned long funcid,
 		ret = sbi_pmu_ctr_stop(regs->a0, regs->a1, regs->a2);
 		break;
 	case SBI_EXT_PMU_SNAPSHOT_SET_SHMEM:
-		/* fallthrough as OpenSBI doesn't support snapshot yet */
+		ret = sbi_pmu_snapshot_set_shmem(
+				EXTRACT_FIELD(regs->mstatus, MSTATUS_MPP),
+				regs->a0, regs->a1, regs->a2);
+		break;
 	default:
 		ret = SBI_ENOTSUPP;
 	}
@@ -993,6 +993,13 @@ int sbi_hart_init(struct sbi_scratch *scratch, bool cold_boot)
 
 void __attribute__((noreturn)) sbi_hart_hang(void)
 {
+	/*
+	 * Make sure messages explaining the hang reach the console. Only
+	 * fatal paths switch the console to synchronous output since
+	 * HARTs are also parked here during normal boot.
+	 */
+	sbi_console_flush();
+
 	while (1)
 		wfi();
 	__builtin_unreachable();
@@ -25,7 +25,7 @@ struct heap_node {
 };
 
 struct heap_control {
-	spinlock_t lock;
+	mcs_spinlock_t lock;
 	unsigned long base;
 	unsigned long size;
 	unsigned long hkbase;
@@ -48,7 +48,7 @@ void *sbi_malloc(size_t size)
 	size += HEAP_ALLOC_ALIGN - 1;
 	size &= ~((unsigned long)HEAP_ALLOC_ALIGN - 1);
 
-	spin_lock(&hpctrl.lock);
+	mcs_spin_lock(&hpctrl.lock);
 
 	np = NULL;
 	sbi_list_for_each_entry(n, &hpctrl.free_space_list, head) {
@@ -75,7 +75,7 @@ void *sbi_malloc(size_t size)
 		}
 	}
 
-	spin_unlock(&hpctrl.lock);
+	mcs_spin_unlock(&hpctrl.lock);
 
 	return ret;
 }
@@ -96,7 +96,7 @@ void sbi_free(void *ptr)
 	if (!ptr)
 		return;
 
-	spin_lock(&hpctrl.lock);
+	mcs_spin_lock(&hpctrl.lock);
 
 	np = NULL;
 	sbi_list_for_each_entry(n, &hpctrl.used_space_list, head) {
@@ -107,7 +107,7 @@ void sbi_free(void *ptr)
 		}
 	}
 	if (!np) {
-		spin_unlock(&hpctrl.lock);
+		mcs_spin_unlock(&hpctrl.lock);
 		return;
 	}
 
@@ -134,7 +134,7 @@ void sbi_free(void *ptr)
 	if (np)
 		sbi_list_add_tail(&np->head, &hpctrl.free_space_list);
 
-	spin_unlock(&hpctrl.lock);
+	mcs_spin_unlock(&hpctrl.lock);
 }
 
 unsigned long sbi_heap_free_space(void)
@@ -142,10 +142,10 @@ unsigned long sbi_heap_free_space(void)
 	struct heap_node *n;
 	unsigned long ret = 0;
 
-	spin_lock(&hpctrl.lock);
+	mcs_spin_lock(&hpctrl.lock);
 	sbi_list_for_each_entry(n, &hpctrl.free_space_list, head)
 		ret += n->size;
-	spin_unlock(&hpctrl.lock);
+	mcs_spin_unlock(&hpctrl.lock);
 
 	return ret;
 }
@@ -174,7 +174,7 @@ int sbi_heap_init(struct sbi_scratch *scratch)
 		return SBI_EINVAL;
 
 	/* Initialize heap control */
-	SPIN_LOCK_INIT(hpctrl.lock);
+	MCS_SPIN_LOCK_INIT(hpctrl.lock);
 	hpctrl.base = scratch->fw_start + scratch->fw_heap_offset;
 	hpctrl.size = scratch->fw_heap_size;
 	hpctrl.hkbase = hpctrl.base;
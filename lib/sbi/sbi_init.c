@@ -28,6 +28,8 @@
 #include <sbi/sbi_string.h>
 #include <sbi/sbi_timer.h>
 #include <sbi/sbi_tlb.h>
+#include <sbi/sbi_trace.h>
+#include <sbi/sbi_trap_profile.h>
 #include <sbi/sbi_version.h>
 
 #define BANNER                                              \
@@ -189,7 +191,7 @@ static void sbi_boot_print_hart(struct sbi_scratch *scratch, u32 hartid)
 	sbi_hart_delegation_dump(scratch, "Boot HART ", "         ");
 }
 
-static spinlock_t coldboot_lock = SPIN_LOCK_INITIALIZER;
+static DEFINE_SPIN_LOCK(coldboot_lock);
 static struct sbi_hartmask coldboot_wait_hmask = { 0 };
 
 static unsigned long coldboot_done;
@@ -318,6 +320,14 @@ static void __noreturn init_coldboot(struct sbi_scratch *scratch, u32 hartid)
 	if (rc)
 		sbi_hart_hang();
 
+	rc = sbi_trace_init(scratch, true);
+	if (rc)
+		sbi_hart_hang();
+
+	rc = sbi_trap_profile_init(scratch, true);
+	if (rc)
+		sbi_hart_hang();
+
 	rc = sbi_pmu_init(scratch, true);
 	if (rc) {
 		sbi_printf("%s: pmu init failed (error %d)\n",
@@ -411,6 +421,9 @@ static void __noreturn init_coldboot(struct sbi_scratch *scratch, u32 hartid)
 
 	wake_coldboot_harts(scratch, hartid);
 
+	/* Boot messages must be out before the next stage prints */
+	sbi_console_flush();
+
 	count = sbi_scratch_offset_ptr(scratch, init_count_offset);
 	(*count)++;
 
@@ -22,6 +22,7 @@
 #include <sbi/sbi_pmu.h>
 #include <sbi/sbi_string.h>
 #include <sbi/sbi_tlb.h>
+#include <sbi/sbi_trace.h>
 
 struct sbi_ipi_data {
 	unsigned long ipi_type;
@@ -55,6 +56,9 @@ static int sbi_ipi_send(struct sbi_scratch *scratch, u32 remote_hartindex,
 
 	ipi_data = sbi_scratch_offset_ptr(remote_scratch, ipi_data_off);
 
+	sbi_trace("ipi: send event %lu to hart%u\n", event,
+		  sbi_hartindex_to_hartid(remote_hartindex));
+
 	if (ipi_ops->update) {
 		ret = ipi_ops->update(scratch, remote_scratch,
 				      remote_hartindex, data);
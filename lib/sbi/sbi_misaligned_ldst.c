@@ -10,9 +10,11 @@
 #include <sbi/riscv_asm.h>
 #include <sbi/riscv_encoding.h>
 #include <sbi/riscv_fp.h>
+#include <sbi/sbi_domain.h>
 #include <sbi/sbi_error.h>
 #include <sbi/sbi_misaligned_ldst.h>
 #include <sbi/sbi_pmu.h>
+#include <sbi/sbi_string.h>
 #include <sbi/sbi_trap.h>
 #include <sbi/sbi_unpriv.h>
 
@@ -22,6 +24,24 @@ union reg_data {
 	u64 data_u64;
 };
 
+/** Decoded misaligned load or store */
+struct misaligned_insn {
+	/**
+	 * Instruction with compressed register fields moved to the
+	 * standard rd/rs2 positions so that SET_RD() and GET_RS2()
+	 * work for every encoding
+	 */
+	ulong insn;
+	/** Length of the trapping instruction in bytes */
+	u8 insn_len;
+	/** Access width in bytes */
+	u8 len;
+	/** Sign extension shift for integer loads */
+	u8 shift;
+	/** Non-zero for floating-point accesses */
+	u8 fp;
+};
+
 static ulong sbi_misaligned_tinst_fixup(ulong orig_tinst, ulong new_tinst,
 					ulong addr_offset)
 {
@@ -34,36 +54,147 @@ static ulong sbi_misaligned_tinst_fixup(ulong orig_tinst, ulong new_tinst,
 		return orig_tinst | (addr_offset << SH_RS1);
 }
 
-int sbi_misaligned_load_handler(ulong addr, ulong tval2, ulong tinst,
-				struct sbi_trap_regs *regs)
+/*
+ * Whole-word loads also read the bytes around the access, which may have
+ * side effects on devices. They are only used for physical addresses in
+ * an explicit domain region which is not MMIO. The catch-all region of
+ * the root domain also covers devices the platform did not register, and
+ * an address translated by the MMU can not be checked here.
+ */
+static bool misaligned_load_is_memory(ulong addr, int len,
+				      const struct sbi_trap_regs *regs)
 {
-	ulong insn, insn_len;
-	union reg_data val;
-	struct sbi_trap_info uptrap;
-	int i, fp = 0, shift = 0, len = 0;
+	const struct sbi_domain *dom = sbi_domain_thishart_ptr();
+	ulong mpp = EXTRACT_FIELD(regs->mstatus, MSTATUS_MPP);
+	ulong base = addr & ~(sizeof(ulong) - 1);
+	ulong last = (addr + len - 1) | (sizeof(ulong) - 1);
+	const struct sbi_domain_memregion *reg;
+	ulong rend;
 
-	sbi_pmu_ctr_incr_fw(SBI_PMU_FW_MISALIGNED_LOAD);
+#if __riscv_xlen == 32
+	if (regs->mstatusH & MSTATUSH_MPV)
+		return false;
+#else
+	if (regs->mstatus & MSTATUS_MPV)
+		return false;
+#endif
+	if (mpp != PRV_M && (csr_read(CSR_SATP) & SATP_MODE))
+		return false;
 
-	if (tinst & 0x1) {
-		/*
-		 * Bit[0] == 1 implies trapped instruction value is
-		 * transformed instruction or custom instruction.
-		 */
-		insn = tinst | INSN_16BIT_MASK;
-		insn_len = (tinst & 0x2) ? INSN_LEN(insn) : 2;
-	} else {
-		/*
-		 * Bit[0] == 0 implies trapped instruction value is
-		 * zero or special value.
-		 */
-		insn = sbi_get_insn(regs->mepc, &uptrap);
-		if (uptrap.cause) {
-			uptrap.epc = regs->mepc;
-			return sbi_trap_redirect(regs, &uptrap);
+	/* Regions are sorted by size so the first match is the tightest */
+	sbi_domain_for_each_memregion(dom, reg) {
+		if (reg->order >= __riscv_xlen)
+			return false;
+		rend = reg->base + ((1UL << reg->order) - 1);
+		if (base < reg->base || rend < base)
+			continue;
+		if (rend < last || (reg->flags & SBI_DOMAIN_MEMREGION_MMIO))
+			return false;
+		return sbi_domain_check_addr_range(dom, base, last - base + 1,
+						   mpp, SBI_DOMAIN_READ);
+	}
+
+	return false;
+}
+
+/*
+ * Read len bytes at a misaligned address using the naturally aligned
+ * words covering them. Returns false if one of the loads traps so that
+ * the caller can redo the access piece by piece to report the exact
+ * faulting address.
+ */
+static bool misaligned_load_words(ulong addr, int len, union reg_data *val)
+{
+	ulong w[(sizeof(val->data_bytes) / sizeof(ulong)) + 1];
+	ulong base = addr & ~(sizeof(ulong) - 1);
+	ulong size = (addr - base + len + sizeof(ulong) - 1) &
+		     ~(sizeof(ulong) - 1);
+	struct sbi_trap_info trap;
+
+	sbi_copy_from_unpriv(w, (const void *)base, size, &trap);
+	if (trap.cause)
+		return false;
+
+	sbi_memcpy(val->data_bytes, (u8 *)w + (addr - base), len);
+	return true;
+}
+
+/*
+ * Read len bytes at a misaligned address using the largest naturally
+ * aligned loads which stay within the span so that neighbouring bytes,
+ * possibly device registers, are never read. Returns the offset of the
+ * faulting load or len.
+ */
+static int misaligned_load_pieces(ulong addr, int len, union reg_data *val,
+				  struct sbi_trap_info *uptrap)
+{
+	ulong a;
+	u32 v;
+	int i, n;
+
+	for (i = 0; i < len; i += n) {
+		a = addr + i;
+		if (!(a & 0x3) && len - i >= 4) {
+			n = 4;
+			v = sbi_load_u32((const u32 *)a, uptrap);
+		} else if (!(a & 0x1) && len - i >= 2) {
+			n = 2;
+			v = sbi_load_u16((const u16 *)a, uptrap);
+		} else {
+			n = 1;
+			v = sbi_load_u8((const u8 *)a, uptrap);
+		}
+		if (uptrap->cause)
+			return i;
+		sbi_memcpy(&val->data_bytes[i], &v, n);
+	}
+
+	return len;
+}
+
+/*
+ * Write len bytes at a misaligned address using the largest naturally
+ * aligned stores which stay within the span so that neighbouring bytes
+ * are never rewritten. Returns the offset of the faulting store or len.
+ * A misaligned access never covers a whole naturally aligned u64.
+ */
+static int misaligned_store_pieces(ulong addr, int len, union reg_data *val,
+				   struct sbi_trap_info *uptrap)
+{
+	ulong a;
+	int i, n;
+
+	for (i = 0; i < len; i += n) {
+		a = addr + i;
+		if (!(a & 0x3) && len - i >= 4) {
+			n = 4;
+			sbi_store_u32((u32 *)a,
+				      (u32)val->data_bytes[i] |
+				      (u32)val->data_bytes[i + 1] << 8 |
+				      (u32)val->data_bytes[i + 2] << 16 |
+				      (u32)val->data_bytes[i + 3] << 24,
+				      uptrap);
+		} else if (!(a & 0x1) && len - i >= 2) {
+			n = 2;
+			sbi_store_u16((u16 *)a,
+				      (u16)val->data_bytes[i] |
+				      (u16)val->data_bytes[i + 1] << 8,
+				      uptrap);
+		} else {
+			n = 1;
+			sbi_store_u8((u8 *)a, val->data_bytes[i], uptrap);
 		}
-		insn_len = INSN_LEN(insn);
+		if (uptrap->cause)
+			return i;
 	}
 
+	return len;
+}
+
+static bool misaligned_load_decode(ulong insn, struct misaligned_insn *dec)
+{
+	int fp = 0, shift = 0, len = 0;
+
 	if ((insn & INSN_MASK_LW) == INSN_MATCH_LW) {
 		len   = 4;
 		shift = 8 * (sizeof(ulong) - len);
@@ -131,72 +262,23 @@ int sbi_misaligned_load_handler(ulong addr, ulong tval2, ulong tinst,
 		shift = 8 * (sizeof(ulong) - len);
 		insn = RVC_RS2S(insn) << SH_RD;
 	} else {
-		uptrap.epc = regs->mepc;
-		uptrap.cause = CAUSE_MISALIGNED_LOAD;
-		uptrap.tval = addr;
-		uptrap.tval2 = tval2;
-		uptrap.tinst = tinst;
-		uptrap.gva   = sbi_regs_gva(regs);
-		return sbi_trap_redirect(regs, &uptrap);
-	}
-
-	val.data_u64 = 0;
-	for (i = 0; i < len; i++) {
-		val.data_bytes[i] = sbi_load_u8((void *)(addr + i),
-						&uptrap);
-		if (uptrap.cause) {
-			uptrap.epc = regs->mepc;
-			uptrap.tinst = sbi_misaligned_tinst_fixup(
-				tinst, uptrap.tinst, i);
-			return sbi_trap_redirect(regs, &uptrap);
-		}
+		return false;
 	}
 
-	if (!fp)
-		SET_RD(insn, regs, ((long)(val.data_ulong << shift)) >> shift);
-#ifdef __riscv_flen
-	else if (len == 8)
-		SET_F64_RD(insn, regs, val.data_u64);
-	else
-		SET_F32_RD(insn, regs, val.data_ulong);
-#endif
-
-	regs->mepc += insn_len;
-
-	return 0;
+	dec->insn  = insn;
+	dec->len   = len;
+	dec->shift = shift;
+	dec->fp    = fp;
+	return true;
 }
 
-int sbi_misaligned_store_handler(ulong addr, ulong tval2, ulong tinst,
-				 struct sbi_trap_regs *regs)
+/*
+ * Compressed encodings have their source register moved to the standard
+ * rs2 field so that the handler reads it the same way for all of them.
+ */
+static bool misaligned_store_decode(ulong insn, struct misaligned_insn *dec)
 {
-	ulong insn, insn_len;
-	union reg_data val;
-	struct sbi_trap_info uptrap;
-	int i, len = 0;
-
-	sbi_pmu_ctr_incr_fw(SBI_PMU_FW_MISALIGNED_STORE);
-
-	if (tinst & 0x1) {
-		/*
-		 * Bit[0] == 1 implies trapped instruction value is
-		 * transformed instruction or custom instruction.
-		 */
-		insn = tinst | INSN_16BIT_MASK;
-		insn_len = (tinst & 0x2) ? INSN_LEN(insn) : 2;
-	} else {
-		/*
-		 * Bit[0] == 0 implies trapped instruction value is
-		 * zero or special value.
-		 */
-		insn = sbi_get_insn(regs->mepc, &uptrap);
-		if (uptrap.cause) {
-			uptrap.epc = regs->mepc;
-			return sbi_trap_redirect(regs, &uptrap);
-		}
-		insn_len = INSN_LEN(insn);
-	}
-
-	val.data_ulong = GET_RS2(insn, regs);
+	int fp = 0, len = 0;
 
 	if ((insn & INSN_MASK_SW) == INSN_MATCH_SW) {
 		len = 4;
@@ -206,61 +288,123 @@ int sbi_misaligned_store_handler(ulong addr, ulong tval2, ulong tinst,
 #endif
 #ifdef __riscv_flen
 	} else if ((insn & INSN_MASK_FSD) == INSN_MATCH_FSD) {
-		len	     = 8;
-		val.data_u64 = GET_F64_RS2(insn, regs);
+		fp  = 1;
+		len = 8;
 	} else if ((insn & INSN_MASK_FSW) == INSN_MATCH_FSW) {
-		len	       = 4;
-		val.data_ulong = GET_F32_RS2(insn, regs);
+		fp  = 1;
+		len = 4;
 #endif
 	} else if ((insn & INSN_MASK_SH) == INSN_MATCH_SH) {
 		len = 2;
 #if __riscv_xlen >= 64
 	} else if ((insn & INSN_MASK_C_SD) == INSN_MATCH_C_SD) {
-		len	       = 8;
-		val.data_ulong = GET_RS2S(insn, regs);
+		len  = 8;
+		insn = RVC_RS2S(insn) << SH_RS2;
 	} else if ((insn & INSN_MASK_C_SDSP) == INSN_MATCH_C_SDSP) {
-		len	       = 8;
-		val.data_ulong = GET_RS2C(insn, regs);
+		len  = 8;
+		insn = RVC_RS2(insn) << SH_RS2;
 #endif
 	} else if ((insn & INSN_MASK_C_SW) == INSN_MATCH_C_SW) {
-		len	       = 4;
-		val.data_ulong = GET_RS2S(insn, regs);
+		len  = 4;
+		insn = RVC_RS2S(insn) << SH_RS2;
 	} else if ((insn & INSN_MASK_C_SWSP) == INSN_MATCH_C_SWSP) {
-		len	       = 4;
-		val.data_ulong = GET_RS2C(insn, regs);
+		len  = 4;
+		insn = RVC_RS2(insn) << SH_RS2;
 #ifdef __riscv_flen
 	} else if ((insn & INSN_MASK_C_FSD) == INSN_MATCH_C_FSD) {
-		len	     = 8;
-		val.data_u64 = GET_F64_RS2S(insn, regs);
+		fp   = 1;
+		len  = 8;
+		insn = RVC_RS2S(insn) << SH_RS2;
 	} else if ((insn & INSN_MASK_C_FSDSP) == INSN_MATCH_C_FSDSP) {
-		len	     = 8;
-		val.data_u64 = GET_F64_RS2C(insn, regs);
+		fp   = 1;
+		len  = 8;
+		insn = RVC_RS2(insn) << SH_RS2;
 #if __riscv_xlen == 32
 	} else if ((insn & INSN_MASK_C_FSW) == INSN_MATCH_C_FSW) {
-		len	       = 4;
-		val.data_ulong = GET_F32_RS2S(insn, regs);
+		fp   = 1;
+		len  = 4;
+		insn = RVC_RS2S(insn) << SH_RS2;
 	} else if ((insn & INSN_MASK_C_FSWSP) == INSN_MATCH_C_FSWSP) {
-		len	       = 4;
-		val.data_ulong = GET_F32_RS2C(insn, regs);
+		fp   = 1;
+		len  = 4;
+		insn = RVC_RS2(insn) << SH_RS2;
 #endif
 #endif
 	} else if ((insn & INSN_MASK_C_SH) == INSN_MATCH_C_SH) {
-		len		= 2;
-		val.data_ulong = GET_RS2S(insn, regs);
+		len  = 2;
+		insn = RVC_RS2S(insn) << SH_RS2;
+	} else {
+		return false;
+	}
+
+	dec->insn  = insn;
+	dec->len   = len;
+	dec->shift = 0;
+	dec->fp    = fp;
+	return true;
+}
+
+/*
+ * Fetch the trapping instruction unless the trap provided it in tinst.
+ * Returns false with uptrap set if the fetch faulted.
+ */
+static bool misaligned_get_insn(ulong tinst, struct sbi_trap_regs *regs,
+				ulong *insn, ulong *insn_len,
+				struct sbi_trap_info *uptrap)
+{
+	if (tinst & 0x1) {
+		/*
+		 * Bit[0] == 1 implies trapped instruction value is
+		 * transformed instruction or custom instruction.
+		 */
+		*insn = tinst | INSN_16BIT_MASK;
+		*insn_len = (tinst & 0x2) ? INSN_LEN(*insn) : 2;
 	} else {
+		/*
+		 * Bit[0] == 0 implies trapped instruction value is
+		 * zero or special value.
+		 */
+		*insn = sbi_get_insn(regs->mepc, uptrap);
+		if (uptrap->cause)
+			return false;
+		*insn_len = INSN_LEN(*insn);
+	}
+
+	return true;
+}
+
+int sbi_misaligned_load_handler(ulong addr, ulong tval2, ulong tinst,
+				struct sbi_trap_regs *regs)
+{
+	ulong insn, insn_len;
+	union reg_data val;
+	struct misaligned_insn dec;
+	struct sbi_trap_info uptrap;
+	int i;
+
+	sbi_pmu_ctr_incr_fw(SBI_PMU_FW_MISALIGNED_LOAD);
+
+	if (!misaligned_get_insn(tinst, regs, &insn, &insn_len, &uptrap)) {
 		uptrap.epc = regs->mepc;
-		uptrap.cause = CAUSE_MISALIGNED_STORE;
+		return sbi_trap_redirect(regs, &uptrap);
+	}
+
+	if (!misaligned_load_decode(insn, &dec)) {
+		uptrap.epc = regs->mepc;
+		uptrap.cause = CAUSE_MISALIGNED_LOAD;
 		uptrap.tval = addr;
 		uptrap.tval2 = tval2;
 		uptrap.tinst = tinst;
 		uptrap.gva   = sbi_regs_gva(regs);
 		return sbi_trap_redirect(regs, &uptrap);
 	}
+	dec.insn_len = insn_len;
 
-	for (i = 0; i < len; i++) {
-		sbi_store_u8((void *)(addr + i), val.data_bytes[i],
-			     &uptrap);
-		if (uptrap.cause) {
+	val.data_u64 = 0;
+	if (!misaligned_load_is_memory(addr, dec.len, regs) ||
+	    !misaligned_load_words(addr, dec.len, &val)) {
+		i = misaligned_load_pieces(addr, dec.len, &val, &uptrap);
+		if (i < dec.len) {
 			uptrap.epc = regs->mepc;
 			uptrap.tinst = sbi_misaligned_tinst_fixup(
 				tinst, uptrap.tinst, i);
@@ -268,7 +412,67 @@ int sbi_misaligned_store_handler(ulong addr, ulong tval2, ulong tinst,
 		}
 	}
 
-	regs->mepc += insn_len;
+	if (!dec.fp)
+		SET_RD(dec.insn, regs,
+		       ((long)(val.data_ulong << dec.shift)) >> dec.shift);
+#ifdef __riscv_flen
+	else if (dec.len == 8)
+		SET_F64_RD(dec.insn, regs, val.data_u64);
+	else
+		SET_F32_RD(dec.insn, regs, val.data_ulong);
+#endif
+
+	regs->mepc += dec.insn_len;
+
+	return 0;
+}
+
+int sbi_misaligned_store_handler(ulong addr, ulong tval2, ulong tinst,
+				 struct sbi_trap_regs *regs)
+{
+	ulong insn, insn_len;
+	union reg_data val;
+	struct misaligned_insn dec;
+	struct sbi_trap_info uptrap;
+	int i;
+
+	sbi_pmu_ctr_incr_fw(SBI_PMU_FW_MISALIGNED_STORE);
+
+	if (!misaligned_get_insn(tinst, regs, &insn, &insn_len, &uptrap)) {
+		uptrap.epc = regs->mepc;
+		return sbi_trap_redirect(regs, &uptrap);
+	}
+
+	if (!misaligned_store_decode(insn, &dec)) {
+		uptrap.epc = regs->mepc;
+		uptrap.cause = CAUSE_MISALIGNED_STORE;
+		uptrap.tval = addr;
+		uptrap.tval2 = tval2;
+		uptrap.tinst = tinst;
+		uptrap.gva   = sbi_regs_gva(regs);
+		return sbi_trap_redirect(regs, &uptrap);
+	}
+	dec.insn_len = insn_len;
+
+	val.data_u64 = 0;
+	if (!dec.fp)
+		val.data_ulong = GET_RS2(dec.insn, regs);
+#ifdef __riscv_flen
+	else if (dec.len == 8)
+		val.data_u64 = GET_F64_RS2(dec.insn, regs);
+	else
+		val.data_ulong = GET_F32_RS2(dec.insn, regs);
+#endif
+
+	i = misaligned_store_pieces(addr, dec.len, &val, &uptrap);
+	if (uptrap.cause) {
+		uptrap.epc = regs->mepc;
+		uptrap.tinst = sbi_misaligned_tinst_fixup(
+			tinst, uptrap.tinst, i);
+		return sbi_trap_redirect(regs, &uptrap);
+	}
+
+	regs->mepc += dec.insn_len;
 
 	return 0;
 }
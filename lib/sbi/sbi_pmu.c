@@ -10,6 +10,7 @@
 #include <sbi/riscv_asm.h>
 #include <sbi/sbi_bitops.h>
 #include <sbi/sbi_console.h>
+#include <sbi/sbi_domain.h>
 #include <sbi/sbi_ecall_interface.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_heap.h>
@@ -17,6 +18,7 @@
 #include <sbi/sbi_pmu.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_string.h>
+#include <sbi/sbi_timer.h>
 
 /** Information about hardware counters */
 struct sbi_pmu_hw_event {
@@ -54,6 +56,44 @@ union sbi_pmu_ctr_info {
 #error "Can't handle firmware counters beyond BITS_PER_LONG"
 #endif
 
+/* Layout of the counter snapshot shared memory as per SBI specification */
+struct sbi_pmu_snapshot {
+	/* Bit i is set when counter cidx_base + i has overflowed */
+	uint64_t ctr_overflow_mask;
+	/* Value of counter cidx_base + i */
+	uint64_t ctr_values[64];
+	uint64_t reserved[447];
+};
+
+#define PMU_SNAPSHOT_DISABLED		(-1UL)
+
+#ifdef CONFIG_SBI_PMU_MULTIPLEX
+
+/* Time slice of multiplexed hardware events in milliseconds */
+#define PMU_MUX_PERIOD_MS		4
+
+/** Hardware event multiplexed on a firmware counter */
+struct pmu_mux_event {
+	/* Event and configuration used to program a hardware counter */
+	unsigned long event_idx;
+	uint64_t data;
+	unsigned long flags;
+	/* Hardware counter currently counting the event, zero if none */
+	uint32_t hw_cidx;
+	/* Initial value given when the counter was last started */
+	uint64_t base;
+	/* Events counted while on a hardware counter */
+	uint64_t count;
+	/* Timer ticks spent started and spent on a hardware counter */
+	uint64_t enabled;
+	uint64_t running;
+	/* Time of the last start and of the last schedule in */
+	uint64_t enabled_stamp;
+	uint64_t running_stamp;
+};
+
+#endif
+
 /** Per-HART state of the PMU counters */
 struct sbi_pmu_hart_state {
 	/* HART to which this state belongs */
@@ -62,12 +102,31 @@ struct sbi_pmu_hart_state {
 	uint32_t active_events[SBI_PMU_HW_CTR_MAX + SBI_PMU_FW_CTR_MAX];
 	/* Bitmap of firmware counters started */
 	unsigned long fw_counters_started;
+	/* Bitmap of started firmware counters for each SBI firmware event */
+	unsigned long fw_event_counters[SBI_PMU_FW_MAX];
 	/*
 	 * Counter values for SBI firmware events and event codes
 	 * for platform firmware events. Both are mutually exclusive
 	 * and hence can optimally share the same memory.
 	 */
 	uint64_t fw_counters_data[SBI_PMU_FW_CTR_MAX];
+	/*
+	 * Source count when a firmware source counter was started
+	 * adjusted by its initial value, or its value while stopped.
+	 */
+	uint64_t fw_counters_base[SBI_PMU_FW_CTR_MAX];
+	/* Physical address of the snapshot shared memory */
+	unsigned long snapshot_addr;
+#ifdef CONFIG_SBI_PMU_MULTIPLEX
+	/* Bitmap of firmware counters multiplexing hardware events */
+	unsigned long mux_counters;
+	/* Bitmap of multiplexed counters started */
+	unsigned long mux_started;
+	/* Multiplexed counter scheduled first by the next rotation */
+	uint32_t mux_next;
+	struct pmu_mux_event mux[SBI_PMU_FW_CTR_MAX];
+	struct sbi_timer_event mux_ev;
+#endif
 };
 
 /** Offset of pointer to PMU HART state in scratch space */
@@ -96,11 +155,193 @@ static uint32_t num_hw_ctrs;
 /* Maximum number of counters available */
 static uint32_t total_ctrs;
 
+#ifdef CONFIG_SBI_PMU_MULTIPLEX
+
+static inline bool pmu_mux_counter(struct sbi_pmu_hart_state *phs,
+				   uint32_t cidx)
+{
+	return cidx >= num_hw_ctrs && cidx < total_ctrs &&
+	       (phs->mux_counters & BIT(cidx - num_hw_ctrs));
+}
+
+static int pmu_mux_alloc(struct sbi_pmu_hart_state *phs,
+			 unsigned long cbase, unsigned long cmask,
+			 unsigned long flags, unsigned long event_idx,
+			 uint64_t data);
+static int pmu_mux_preempt(struct sbi_pmu_hart_state *phs,
+			   unsigned long cbase, unsigned long cmask,
+			   unsigned long flags, unsigned long event_idx,
+			   uint64_t data);
+static void pmu_mux_release(struct sbi_pmu_hart_state *phs, uint32_t cidx);
+static void pmu_mux_write(struct sbi_pmu_hart_state *phs, uint32_t cidx,
+			  uint64_t val);
+static uint64_t pmu_mux_read(struct sbi_pmu_hart_state *phs, uint32_t cidx);
+static int pmu_mux_start(struct sbi_pmu_hart_state *phs, uint32_t cidx,
+			 uint64_t ival, bool ival_update);
+static int pmu_mux_stop(struct sbi_pmu_hart_state *phs, uint32_t cidx);
+static void pmu_mux_reset(struct sbi_pmu_hart_state *phs);
+
+#else
+
+static inline bool pmu_mux_counter(struct sbi_pmu_hart_state *phs,
+				   uint32_t cidx)
+{
+	return false;
+}
+
+static inline int pmu_mux_alloc(struct sbi_pmu_hart_state *phs,
+				unsigned long cbase, unsigned long cmask,
+				unsigned long flags, unsigned long event_idx,
+				uint64_t data)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline int pmu_mux_preempt(struct sbi_pmu_hart_state *phs,
+				  unsigned long cbase, unsigned long cmask,
+				  unsigned long flags, unsigned long event_idx,
+				  uint64_t data)
+{
+	return SBI_ENOTSUPP;
+}
+
+static inline void pmu_mux_release(struct sbi_pmu_hart_state *phs,
+				   uint32_t cidx) { }
+
+static inline void pmu_mux_write(struct sbi_pmu_hart_state *phs,
+				 uint32_t cidx, uint64_t val) { }
+
+static inline uint64_t pmu_mux_read(struct sbi_pmu_hart_state *phs,
+				    uint32_t cidx)
+{
+	return 0;
+}
+
+static inline int pmu_mux_start(struct sbi_pmu_hart_state *phs,
+				uint32_t cidx, uint64_t ival, bool ival_update)
+{
+	return SBI_EINVAL;
+}
+
+static inline int pmu_mux_stop(struct sbi_pmu_hart_state *phs,
+			       uint32_t cidx)
+{
+	return SBI_EINVAL;
+}
+
+static inline void pmu_mux_reset(struct sbi_pmu_hart_state *phs) { }
+
+#endif
+
 /* Helper macros to retrieve event idx and code type */
 #define get_cidx_type(x) \
   (((x) & SBI_PMU_EVENT_IDX_TYPE_MASK) >> SBI_PMU_EVENT_IDX_TYPE_OFFSET)
 #define get_cidx_code(x) (x & SBI_PMU_EVENT_IDX_CODE_MASK)
 
+/* Sources of platform firmware events counted by OpenSBI itself */
+static const struct sbi_pmu_fw_source *fw_sources[SBI_PMU_FW_SOURCE_MAX];
+static uint32_t num_fw_sources;
+
+static void pmu_fw_ctr_set_started(struct sbi_pmu_hart_state *phs,
+				   uint32_t fidx, uint32_t event_code)
+{
+	phs->fw_counters_started |= BIT(fidx);
+	if (event_code < SBI_PMU_FW_MAX)
+		phs->fw_event_counters[event_code] |= BIT(fidx);
+}
+
+static void pmu_fw_ctr_set_stopped(struct sbi_pmu_hart_state *phs,
+				   uint32_t fidx, uint32_t event_code)
+{
+	phs->fw_counters_started &= ~BIT(fidx);
+	if (event_code < SBI_PMU_FW_MAX)
+		phs->fw_event_counters[event_code] &= ~BIT(fidx);
+}
+
+static const struct sbi_pmu_fw_source *pmu_fw_source_find(uint32_t event_code,
+							 uint64_t edata)
+{
+	const struct sbi_pmu_fw_source *src;
+	uint32_t i, tag;
+
+	if (SBI_PMU_FW_PLATFORM != event_code)
+		return NULL;
+
+	tag = (edata >> SBI_PMU_FW_SOURCE_TAG_SHIFT) &
+	      SBI_PMU_FW_SOURCE_TAG_MASK;
+	for (i = 0; i < num_fw_sources; i++) {
+		src = fw_sources[i];
+		if (src->tag == tag &&
+		    (!src->event_valid || src->event_valid(edata)))
+			return src;
+	}
+
+	return NULL;
+}
+
+static uint64_t pmu_fw_source_read(struct sbi_pmu_hart_state *phs,
+				   const struct sbi_pmu_fw_source *src,
+				   uint32_t fidx)
+{
+	uint64_t edata = phs->fw_counters_data[fidx];
+
+	if (phs->fw_counters_started & BIT(fidx))
+		return src->event_read(edata) - phs->fw_counters_base[fidx];
+
+	return phs->fw_counters_base[fidx];
+}
+
+static void pmu_fw_source_write(struct sbi_pmu_hart_state *phs,
+				const struct sbi_pmu_fw_source *src,
+				uint32_t fidx, uint64_t val)
+{
+	uint64_t edata = phs->fw_counters_data[fidx];
+
+	if (phs->fw_counters_started & BIT(fidx))
+		phs->fw_counters_base[fidx] = src->event_read(edata) - val;
+	else
+		phs->fw_counters_base[fidx] = val;
+}
+
+static void pmu_fw_source_start(struct sbi_pmu_hart_state *phs,
+				const struct sbi_pmu_fw_source *src,
+				uint32_t fidx)
+{
+	uint64_t val = pmu_fw_source_read(phs, src, fidx);
+
+	phs->fw_counters_started |= BIT(fidx);
+	pmu_fw_source_write(phs, src, fidx, val);
+}
+
+static void pmu_fw_source_stop(struct sbi_pmu_hart_state *phs,
+			       const struct sbi_pmu_fw_source *src,
+			       uint32_t fidx)
+{
+	uint64_t val = pmu_fw_source_read(phs, src, fidx);
+
+	phs->fw_counters_started &= ~BIT(fidx);
+	pmu_fw_source_write(phs, src, fidx, val);
+}
+
+int sbi_pmu_register_fw_source(const struct sbi_pmu_fw_source *src)
+{
+	uint32_t i;
+
+	if (!src || !src->event_read)
+		return SBI_EINVAL;
+
+	for (i = 0; i < num_fw_sources; i++) {
+		if (fw_sources[i]->tag == src->tag)
+			return SBI_EALREADY;
+	}
+
+	if (num_fw_sources >= SBI_PMU_FW_SOURCE_MAX)
+		return SBI_ENOSPC;
+
+	fw_sources[num_fw_sources++] = src;
+	return 0;
+}
+
 /**
  * Perform a sanity check on event & counter mappings with event range overlap check
  * @param evtA Pointer to the existing hw event structure
@@ -145,6 +386,9 @@ static int pmu_event_validate(struct sbi_pmu_hart_state *phs,
 		    event_idx_code > SBI_PMU_FW_PLATFORM)
 			return SBI_EINVAL;
 
+		if (pmu_fw_source_find(event_idx_code, edata))
+			return event_idx_type;
+
 		if (SBI_PMU_FW_PLATFORM == event_idx_code &&
 		    pmu_dev && pmu_dev->fw_event_validate_encoding)
 			return pmu_dev->fw_event_validate_encoding(phs->hartid,
@@ -201,6 +445,27 @@ static int pmu_ctr_validate(struct sbi_pmu_hart_state *phs,
 	return event_idx_type;
 }
 
+static uint64_t pmu_ctr_read_fw(struct sbi_pmu_hart_state *phs,
+				uint32_t cidx, uint32_t event_code)
+{
+	const struct sbi_pmu_fw_source *src;
+
+	src = pmu_fw_source_find(event_code,
+				 phs->fw_counters_data[cidx - num_hw_ctrs]);
+	if (src)
+		return pmu_fw_source_read(phs, src, cidx - num_hw_ctrs);
+
+	if (SBI_PMU_FW_PLATFORM == event_code) {
+		if (pmu_dev && pmu_dev->fw_counter_read_value)
+			return pmu_dev->fw_counter_read_value(phs->hartid,
+							      cidx -
+							      num_hw_ctrs);
+		return 0;
+	}
+
+	return phs->fw_counters_data[cidx - num_hw_ctrs];
+}
+
 int sbi_pmu_ctr_fw_read(uint32_t cidx, uint64_t *cval)
 {
 	int event_idx_type;
@@ -210,6 +475,11 @@ int sbi_pmu_ctr_fw_read(uint32_t cidx, uint64_t *cval)
 	if (unlikely(!phs))
 		return SBI_EINVAL;
 
+	if (pmu_mux_counter(phs, cidx)) {
+		*cval = pmu_mux_read(phs, cidx);
+		return 0;
+	}
+
 	event_idx_type = pmu_ctr_validate(phs, cidx, &event_code);
 	if (event_idx_type != SBI_PMU_EVENT_TYPE_FW)
 		return SBI_EINVAL;
@@ -219,15 +489,7 @@ int sbi_pmu_ctr_fw_read(uint32_t cidx, uint64_t *cval)
 	    event_code > SBI_PMU_FW_PLATFORM)
 		return SBI_EINVAL;
 
-	if (SBI_PMU_FW_PLATFORM == event_code) {
-		if (pmu_dev && pmu_dev->fw_counter_read_value)
-			*cval = pmu_dev->fw_counter_read_value(phs->hartid,
-							       cidx -
-							       num_hw_ctrs);
-		else
-			*cval = 0;
-	} else
-		*cval = phs->fw_counters_data[cidx - num_hw_ctrs];
+	*cval = pmu_ctr_read_fw(phs, cidx, event_code);
 
 	return 0;
 }
@@ -347,6 +609,36 @@ static void pmu_ctr_write_hw(uint32_t cidx, uint64_t ival)
 #endif
 }
 
+static uint64_t pmu_ctr_read_hw(uint32_t cidx)
+{
+#if __riscv_xlen == 32
+	uint32_t lo, hi;
+
+	do {
+		hi = csr_read_num(CSR_MCYCLEH + cidx);
+		lo = csr_read_num(CSR_MCYCLE + cidx);
+	} while (hi != csr_read_num(CSR_MCYCLEH + cidx));
+
+	return ((uint64_t)hi << 32) | lo;
+#else
+	return csr_read_num(CSR_MCYCLE + cidx);
+#endif
+}
+
+static bool pmu_ctr_overflowed_hw(uint32_t cidx)
+{
+	if (cidx < 3 || cidx >= SBI_PMU_HW_CTR_MAX ||
+	    !sbi_hart_has_extension(sbi_scratch_thishart_ptr(),
+				    SBI_HART_EXT_SSCOFPMF))
+		return false;
+
+#if __riscv_xlen == 32
+	return csr_read_num(CSR_MHPMEVENT3H + cidx - 3) & MHPMEVENTH_OF;
+#else
+	return csr_read_num(CSR_MHPMEVENT3 + cidx - 3) & MHPMEVENT_OF;
+#endif
+}
+
 static int pmu_ctr_start_hw(uint32_t cidx, uint64_t ival, bool ival_update)
 {
 	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
@@ -401,11 +693,21 @@ static int pmu_ctr_start_fw(struct sbi_pmu_hart_state *phs,
 			    uint64_t event_data, uint64_t ival,
 			    bool ival_update)
 {
+	const struct sbi_pmu_fw_source *src;
+
 	if ((event_code >= SBI_PMU_FW_MAX &&
 	    event_code <= SBI_PMU_FW_RESERVED_MAX) ||
 	    event_code > SBI_PMU_FW_PLATFORM)
 		return SBI_EINVAL;
 
+	src = pmu_fw_source_find(event_code, event_data);
+	if (src) {
+		if (ival_update)
+			pmu_fw_source_write(phs, src, cidx - num_hw_ctrs, ival);
+		pmu_fw_source_start(phs, src, cidx - num_hw_ctrs);
+		return 0;
+	}
+
 	if (SBI_PMU_FW_PLATFORM == event_code) {
 		if (!pmu_dev ||
 		    !pmu_dev->fw_counter_write_value ||
@@ -426,7 +728,7 @@ static int pmu_ctr_start_fw(struct sbi_pmu_hart_state *phs,
 			phs->fw_counters_data[cidx - num_hw_ctrs] = ival;
 	}
 
-	phs->fw_counters_started |= BIT(cidx - num_hw_ctrs);
+	pmu_fw_ctr_set_started(phs, cidx - num_hw_ctrs, event_code);
 
 	return 0;
 }
@@ -445,14 +747,18 @@ int sbi_pmu_ctr_start(unsigned long cbase, unsigned long cmask,
 	bool bUpdate = false;
 	int i, cidx;
 	uint64_t edata;
+	struct sbi_pmu_snapshot *snap = NULL;
 
 	if ((cbase + sbi_fls(cmask)) >= total_ctrs)
 		return ret;
 
-	if (flags & SBI_PMU_STOP_FLAG_TAKE_SNAPSHOT)
-		return SBI_ENO_SHMEM;
-
-	if (flags & SBI_PMU_START_FLAG_SET_INIT_VALUE)
+	if (flags & SBI_PMU_START_FLAG_INIT_FROM_SNAPSHOT) {
+		if (phs->snapshot_addr == PMU_SNAPSHOT_DISABLED)
+			return SBI_ENO_SHMEM;
+		snap = (void *)phs->snapshot_addr;
+		sbi_hart_map_saddr(phs->snapshot_addr, sizeof(*snap));
+		bUpdate = true;
+	} else if (flags & SBI_PMU_START_FLAG_SET_INIT_VALUE)
 		bUpdate = true;
 
 	for_each_set_bit(i, &cmask, BITS_PER_LONG) {
@@ -461,6 +767,10 @@ int sbi_pmu_ctr_start(unsigned long cbase, unsigned long cmask,
 		if (event_idx_type < 0)
 			/* Continue the start operation for other counters */
 			continue;
+		if (snap)
+			ival = snap->ctr_values[i];
+		if (pmu_mux_counter(phs, cidx))
+			ret = pmu_mux_start(phs, cidx, ival, bUpdate);
 		else if (event_idx_type == SBI_PMU_EVENT_TYPE_FW) {
 			edata = (event_code == SBI_PMU_FW_PLATFORM) ?
 				 phs->fw_counters_data[cidx - num_hw_ctrs]
@@ -472,6 +782,9 @@ int sbi_pmu_ctr_start(unsigned long cbase, unsigned long cmask,
 			ret = pmu_ctr_start_hw(cidx, ival, bUpdate);
 	}
 
+	if (snap)
+		sbi_hart_unmap_saddr();
+
 	return ret;
 }
 
@@ -503,6 +816,7 @@ static int pmu_ctr_stop_hw(uint32_t cidx)
 static int pmu_ctr_stop_fw(struct sbi_pmu_hart_state *phs,
 			   uint32_t cidx, uint32_t event_code)
 {
+	const struct sbi_pmu_fw_source *src;
 	int ret;
 
 	if ((event_code >= SBI_PMU_FW_MAX &&
@@ -510,6 +824,13 @@ static int pmu_ctr_stop_fw(struct sbi_pmu_hart_state *phs,
 	    event_code > SBI_PMU_FW_PLATFORM)
 		return SBI_EINVAL;
 
+	src = pmu_fw_source_find(event_code,
+				 phs->fw_counters_data[cidx - num_hw_ctrs]);
+	if (src) {
+		pmu_fw_source_stop(phs, src, cidx - num_hw_ctrs);
+		return 0;
+	}
+
 	if (SBI_PMU_FW_PLATFORM == event_code &&
 	    pmu_dev && pmu_dev->fw_counter_stop) {
 		ret = pmu_dev->fw_counter_stop(phs->hartid, cidx - num_hw_ctrs);
@@ -517,7 +838,7 @@ static int pmu_ctr_stop_fw(struct sbi_pmu_hart_state *phs,
 			return ret;
 	}
 
-	phs->fw_counters_started &= ~BIT(cidx - num_hw_ctrs);
+	pmu_fw_ctr_set_stopped(phs, cidx - num_hw_ctrs, event_code);
 
 	return 0;
 }
@@ -550,12 +871,18 @@ int sbi_pmu_ctr_stop(unsigned long cbase, unsigned long cmask,
 	int event_idx_type;
 	uint32_t event_code;
 	int i, cidx;
+	struct sbi_pmu_snapshot *snap = NULL;
+	uint64_t of_mask = 0;
 
 	if ((cbase + sbi_fls(cmask)) >= total_ctrs)
 		return SBI_EINVAL;
 
-	if (flag & SBI_PMU_STOP_FLAG_TAKE_SNAPSHOT)
-		return SBI_ENO_SHMEM;
+	if (flag & SBI_PMU_STOP_FLAG_TAKE_SNAPSHOT) {
+		if (phs->snapshot_addr == PMU_SNAPSHOT_DISABLED)
+			return SBI_ENO_SHMEM;
+		snap = (void *)phs->snapshot_addr;
+		sbi_hart_map_saddr(phs->snapshot_addr, sizeof(*snap));
+	}
 
 	for_each_set_bit(i, &cmask, BITS_PER_LONG) {
 		cidx = i + cbase;
@@ -564,17 +891,39 @@ int sbi_pmu_ctr_stop(unsigned long cbase, unsigned long cmask,
 			/* Continue the stop operation for other counters */
 			continue;
 
+		else if (pmu_mux_counter(phs, cidx))
+			ret = pmu_mux_stop(phs, cidx);
 		else if (event_idx_type == SBI_PMU_EVENT_TYPE_FW)
 			ret = pmu_ctr_stop_fw(phs, cidx, event_code);
 		else
 			ret = pmu_ctr_stop_hw(cidx);
 
+		/* Save the stopped value before a reset drops the event */
+		if (snap && pmu_mux_counter(phs, cidx)) {
+			snap->ctr_values[i] = pmu_mux_read(phs, cidx);
+		} else if (snap && event_idx_type == SBI_PMU_EVENT_TYPE_FW) {
+			snap->ctr_values[i] = pmu_ctr_read_fw(phs, cidx,
+							      event_code);
+		} else if (snap && cidx != 1) {
+			snap->ctr_values[i] = pmu_ctr_read_hw(cidx);
+			if (pmu_ctr_overflowed_hw(cidx))
+				of_mask |= 1ULL << i;
+		}
+
 		if (cidx > (CSR_INSTRET - CSR_CYCLE) && flag & SBI_PMU_STOP_FLAG_RESET) {
 			phs->active_events[cidx] = SBI_PMU_EVENT_IDX_INVALID;
-			pmu_reset_hw_mhpmevent(cidx);
+			if (pmu_mux_counter(phs, cidx))
+				pmu_mux_release(phs, cidx);
+			else
+				pmu_reset_hw_mhpmevent(cidx);
 		}
 	}
 
+	if (snap) {
+		snap->ctr_overflow_mask = of_mask;
+		sbi_hart_unmap_saddr();
+	}
+
 	return ret;
 }
 
@@ -763,6 +1112,256 @@ static int pmu_ctr_find_hw(struct sbi_pmu_hart_state *phs,
 	return ret;
 }
 
+#ifdef CONFIG_SBI_PMU_MULTIPLEX
+
+/*
+ * Hardware events configured with SBI_PMU_CFG_FLAG_MULTIPLEX when no
+ * hardware counter is free are placed on a firmware counter instead.
+ * Started events then take turns on the programmable counters left free
+ * by the supervisor, rotating every PMU_MUX_PERIOD_MS on the M-mode timer
+ * queue, and reads scale the count by enabled over running time.
+ */
+
+static void pmu_mux_sched_out(struct sbi_pmu_hart_state *phs, uint32_t fidx,
+			      uint64_t now)
+{
+	struct pmu_mux_event *me = &phs->mux[fidx];
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+
+	if (!me->hw_cidx)
+		return;
+
+	if (sbi_hart_priv_version(scratch) >= SBI_HART_PRIV_VER_1_11)
+		csr_set(CSR_MCOUNTINHIBIT, BIT(me->hw_cidx));
+	me->count += pmu_ctr_read_hw(me->hw_cidx);
+	me->running += now - me->running_stamp;
+
+	pmu_reset_hw_mhpmevent(me->hw_cidx);
+	phs->active_events[me->hw_cidx] = SBI_PMU_EVENT_IDX_INVALID;
+	me->hw_cidx = 0;
+}
+
+static bool pmu_mux_sched_in(struct sbi_pmu_hart_state *phs, uint32_t fidx,
+			     uint64_t now)
+{
+	struct pmu_mux_event *me = &phs->mux[fidx];
+	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
+	int hw_cidx;
+
+	hw_cidx = pmu_ctr_find_hw(phs, 0, -1UL, me->flags,
+				  me->event_idx, me->data);
+	if (hw_cidx <= CSR_INSTRET - CSR_CYCLE)
+		return false;
+
+	/* The overflow interrupt stays disabled, the supervisor can't see it */
+	phs->active_events[hw_cidx] = me->event_idx;
+	pmu_ctr_write_hw(hw_cidx, 0);
+	if (sbi_hart_priv_version(scratch) >= SBI_HART_PRIV_VER_1_11)
+		csr_clear(CSR_MCOUNTINHIBIT, BIT(hw_cidx));
+
+	me->hw_cidx = hw_cidx;
+	me->running_stamp = now;
+
+	return true;
+}
+
+static void pmu_mux_timeout(struct sbi_timer_event *ev);
+
+static void pmu_mux_schedule(struct sbi_pmu_hart_state *phs)
+{
+	const struct sbi_timer_device *tdev = sbi_timer_get_device();
+	uint64_t now = sbi_timer_value();
+	unsigned long mask;
+	uint32_t i, fidx;
+	int first_out = -1;
+
+	mask = phs->mux_counters;
+	for_each_set_bit(fidx, &mask, SBI_PMU_FW_CTR_MAX)
+		pmu_mux_sched_out(phs, fidx, now);
+
+	/* Round robin starting with the first event left out last time */
+	for (i = 0; i < SBI_PMU_FW_CTR_MAX; i++) {
+		fidx = (phs->mux_next + i) % SBI_PMU_FW_CTR_MAX;
+		if (!(phs->mux_started & BIT(fidx)))
+			continue;
+		if (!pmu_mux_sched_in(phs, fidx, now) && first_out < 0)
+			first_out = fidx;
+	}
+
+	if (first_out < 0 || !tdev)
+		return;
+
+	phs->mux_next = first_out;
+	phs->mux_ev.callback = pmu_mux_timeout;
+	sbi_timer_event_add(&phs->mux_ev, now +
+			    (tdev->timer_freq / 1000) * PMU_MUX_PERIOD_MS);
+}
+
+static void pmu_mux_timeout(struct sbi_timer_event *ev)
+{
+	struct sbi_pmu_hart_state *phs = pmu_thishart_state_ptr();
+
+	if (phs)
+		pmu_mux_schedule(phs);
+}
+
+static int pmu_mux_alloc(struct sbi_pmu_hart_state *phs,
+			 unsigned long cbase, unsigned long cmask,
+			 unsigned long flags, unsigned long event_idx,
+			 uint64_t data)
+{
+	struct pmu_mux_event *me;
+	int i, cidx;
+
+	/* cycle and instret always have a counter */
+	if (pmu_ctr_find_fixed_hw(event_idx) >= 0)
+		return SBI_ENOTSUPP;
+
+	for_each_set_bit(i, &cmask, BITS_PER_LONG) {
+		cidx = i + cbase;
+		if (cidx < num_hw_ctrs || total_ctrs <= cidx)
+			continue;
+		if (phs->active_events[cidx] != SBI_PMU_EVENT_IDX_INVALID)
+			continue;
+
+		me = &phs->mux[cidx - num_hw_ctrs];
+		sbi_memset(me, 0, sizeof(*me));
+		me->event_idx = event_idx;
+		me->data = data;
+		me->flags = flags;
+		phs->mux_counters |= BIT(cidx - num_hw_ctrs);
+
+		return cidx;
+	}
+
+	return SBI_ENOTSUPP;
+}
+
+/*
+ * Directly configured events take precedence over multiplexed ones, so
+ * take back the hardware counters lent to multiplexed events and retry.
+ * The remaining multiplexed events share what is left afterwards.
+ */
+static int pmu_mux_preempt(struct sbi_pmu_hart_state *phs,
+			   unsigned long cbase, unsigned long cmask,
+			   unsigned long flags, unsigned long event_idx,
+			   uint64_t data)
+{
+	uint64_t now = sbi_timer_value();
+	unsigned long mask;
+	uint32_t fidx;
+	int ctr_idx;
+
+	if (!phs->mux_started)
+		return SBI_ENOTSUPP;
+
+	mask = phs->mux_counters;
+	for_each_set_bit(fidx, &mask, SBI_PMU_FW_CTR_MAX)
+		pmu_mux_sched_out(phs, fidx, now);
+
+	ctr_idx = pmu_ctr_find_hw(phs, cbase, cmask, flags, event_idx, data);
+	if (ctr_idx >= 0)
+		phs->active_events[ctr_idx] = event_idx;
+
+	pmu_mux_schedule(phs);
+
+	return ctr_idx;
+}
+
+static void pmu_mux_release(struct sbi_pmu_hart_state *phs, uint32_t cidx)
+{
+	phs->mux_counters &= ~BIT(cidx - num_hw_ctrs);
+}
+
+static void pmu_mux_write(struct sbi_pmu_hart_state *phs, uint32_t cidx,
+			  uint64_t val)
+{
+	struct pmu_mux_event *me = &phs->mux[cidx - num_hw_ctrs];
+	uint64_t now = sbi_timer_value();
+
+	if (me->hw_cidx) {
+		pmu_ctr_write_hw(me->hw_cidx, 0);
+		me->running_stamp = now;
+	}
+	me->enabled_stamp = now;
+	me->base = val;
+	me->count = 0;
+	me->enabled = 0;
+	me->running = 0;
+}
+
+static uint64_t pmu_mux_read(struct sbi_pmu_hart_state *phs, uint32_t cidx)
+{
+	uint32_t fidx = cidx - num_hw_ctrs;
+	struct pmu_mux_event *me = &phs->mux[fidx];
+	uint64_t now = sbi_timer_value();
+	uint64_t count = me->count;
+	uint64_t enabled = me->enabled;
+	uint64_t running = me->running;
+
+	if (me->hw_cidx) {
+		count += pmu_ctr_read_hw(me->hw_cidx);
+		running += now - me->running_stamp;
+	}
+	if (phs->mux_started & BIT(fidx))
+		enabled += now - me->enabled_stamp;
+
+	if (!running)
+		return me->base;
+	if (running >= enabled)
+		return me->base + count;
+
+	return me->base + (count / running) * enabled +
+	       ((count % running) * enabled) / running;
+}
+
+static int pmu_mux_start(struct sbi_pmu_hart_state *phs, uint32_t cidx,
+			 uint64_t ival, bool ival_update)
+{
+	uint32_t fidx = cidx - num_hw_ctrs;
+
+	if (phs->mux_started & BIT(fidx))
+		return SBI_EALREADY_STARTED;
+
+	if (ival_update)
+		pmu_mux_write(phs, cidx, ival);
+	phs->mux[fidx].enabled_stamp = sbi_timer_value();
+	phs->mux_started |= BIT(fidx);
+
+	pmu_mux_schedule(phs);
+
+	return 0;
+}
+
+static int pmu_mux_stop(struct sbi_pmu_hart_state *phs, uint32_t cidx)
+{
+	uint32_t fidx = cidx - num_hw_ctrs;
+	struct pmu_mux_event *me = &phs->mux[fidx];
+	uint64_t now = sbi_timer_value();
+
+	if (!(phs->mux_started & BIT(fidx)))
+		return SBI_EALREADY_STOPPED;
+
+	pmu_mux_sched_out(phs, fidx, now);
+	me->enabled += now - me->enabled_stamp;
+	phs->mux_started &= ~BIT(fidx);
+
+	/* Hand the freed hardware counter to the remaining events */
+	pmu_mux_schedule(phs);
+
+	return 0;
+}
+
+static void pmu_mux_reset(struct sbi_pmu_hart_state *phs)
+{
+	sbi_timer_event_del(&phs->mux_ev);
+	phs->mux_counters = 0;
+	phs->mux_started = 0;
+	phs->mux_next = 0;
+}
+
+#endif
+
 
 /**
  * Any firmware counter can map to any firmware event.
@@ -787,6 +1386,7 @@ static int pmu_ctr_find_fw(struct sbi_pmu_hart_state *phs,
 		if (phs->active_events[i] != SBI_PMU_EVENT_IDX_INVALID)
 			continue;
 		if (SBI_PMU_FW_PLATFORM == event_code &&
+		    !pmu_fw_source_find(event_code, edata) &&
 		    pmu_dev && pmu_dev->fw_counter_match_encoding) {
 			if (!pmu_dev->fw_counter_match_encoding(phs->hartid,
 							    cidx - num_hw_ctrs,
@@ -810,6 +1410,7 @@ int sbi_pmu_ctr_cfg_match(unsigned long cidx_base, unsigned long cidx_mask,
 		return SBI_EINVAL;
 
 	int ret, event_type, ctr_idx = SBI_ENOTSUPP;
+	const struct sbi_pmu_fw_source *src;
 	u32 event_code;
 
 	/* Do a basic sanity check of counter base & mask */
@@ -847,6 +1448,12 @@ int sbi_pmu_ctr_cfg_match(unsigned long cidx_base, unsigned long cidx_mask,
 	} else {
 		ctr_idx = pmu_ctr_find_hw(phs, cidx_base, cidx_mask, flags,
 					  event_idx, event_data);
+		if (ctr_idx < 0 && (flags & SBI_PMU_CFG_FLAG_MULTIPLEX))
+			ctr_idx = pmu_mux_alloc(phs, cidx_base, cidx_mask,
+						flags, event_idx, event_data);
+		else if (ctr_idx < 0)
+			ctr_idx = pmu_mux_preempt(phs, cidx_base, cidx_mask,
+						  flags, event_idx, event_data);
 	}
 
 	if (ctr_idx < 0)
@@ -854,11 +1461,21 @@ int sbi_pmu_ctr_cfg_match(unsigned long cidx_base, unsigned long cidx_mask,
 
 	phs->active_events[ctr_idx] = event_idx;
 skip_match:
-	if (event_type == SBI_PMU_EVENT_TYPE_HW) {
+	if (pmu_mux_counter(phs, ctr_idx)) {
+		if (flags & SBI_PMU_CFG_FLAG_CLEAR_VALUE)
+			pmu_mux_write(phs, ctr_idx, 0);
+		if (flags & SBI_PMU_CFG_FLAG_AUTO_START)
+			pmu_mux_start(phs, ctr_idx, 0, false);
+	} else if (event_type == SBI_PMU_EVENT_TYPE_HW) {
 		if (flags & SBI_PMU_CFG_FLAG_CLEAR_VALUE)
 			pmu_ctr_write_hw(ctr_idx, 0);
 		if (flags & SBI_PMU_CFG_FLAG_AUTO_START)
 			pmu_ctr_start_hw(ctr_idx, 0, false);
+	} else if ((src = pmu_fw_source_find(event_code, event_data))) {
+		if (flags & SBI_PMU_CFG_FLAG_CLEAR_VALUE)
+			pmu_fw_source_write(phs, src, ctr_idx - num_hw_ctrs, 0);
+		if (flags & SBI_PMU_CFG_FLAG_AUTO_START)
+			pmu_fw_source_start(phs, src, ctr_idx - num_hw_ctrs);
 	} else if (event_type == SBI_PMU_EVENT_TYPE_FW) {
 		if (flags & SBI_PMU_CFG_FLAG_CLEAR_VALUE)
 			phs->fw_counters_data[ctr_idx - num_hw_ctrs] = 0;
@@ -871,7 +1488,8 @@ skip_match:
 				if (ret)
 					return ret;
 			}
-			phs->fw_counters_started |= BIT(ctr_idx - num_hw_ctrs);
+			pmu_fw_ctr_set_started(phs, ctr_idx - num_hw_ctrs,
+					       event_code);
 		}
 	}
 
@@ -880,8 +1498,8 @@ skip_match:
 
 int sbi_pmu_ctr_incr_fw(enum sbi_pmu_fw_event_code_id fw_id)
 {
-	u32 cidx;
-	uint64_t *fcounter = NULL;
+	unsigned long fmask;
+	int fidx;
 	struct sbi_pmu_hart_state *phs = pmu_thishart_state_ptr();
 
 	if (unlikely(!phs))
@@ -893,20 +1511,96 @@ int sbi_pmu_ctr_incr_fw(enum sbi_pmu_fw_event_code_id fw_id)
 	if (unlikely(fw_id >= SBI_PMU_FW_MAX))
 		return SBI_EINVAL;
 
-	for (cidx = num_hw_ctrs; cidx < total_ctrs; cidx++) {
-		if (get_cidx_code(phs->active_events[cidx]) == fw_id &&
-		    (phs->fw_counters_started & BIT(cidx - num_hw_ctrs))) {
-			fcounter = &phs->fw_counters_data[cidx - num_hw_ctrs];
-			break;
-		}
-	}
+	fmask = phs->fw_event_counters[fw_id];
+	for_each_set_bit(fidx, &fmask, SBI_PMU_FW_CTR_MAX)
+		phs->fw_counters_data[fidx]++;
+
+	return 0;
+}
+
+#ifdef CONFIG_SBI_PMU_FW_CYCLES
+
+struct pmu_fw_cycles {
+	/* M-mode cycles indexed by enum sbi_pmu_fw_cycles_event */
+	u64 cycles[SBI_PMU_FW_CYCLES_MAX];
+	/* Cycles spent suspended, which stop the firmware cycle clock */
+	unsigned long idle;
+};
+
+static unsigned long fw_cycles_off;
+
+unsigned long sbi_pmu_fw_cycles_begin(void)
+{
+	struct pmu_fw_cycles *fc;
+
+	if (unlikely(!fw_cycles_off))
+		return 0;
+
+	fc = sbi_scratch_thishart_offset_ptr(fw_cycles_off);
+	return csr_read(CSR_MCYCLE) - fc->idle;
+}
+
+void sbi_pmu_fw_cycles_end(enum sbi_pmu_fw_cycles_event ev,
+			   unsigned long start)
+{
+	struct pmu_fw_cycles *fc;
+
+	if (unlikely(!fw_cycles_off))
+		return;
+
+	fc = sbi_scratch_thishart_offset_ptr(fw_cycles_off);
+	fc->cycles[ev] += csr_read(CSR_MCYCLE) - fc->idle - start;
+}
+
+void sbi_pmu_fw_cycles_idle(unsigned long start)
+{
+	struct pmu_fw_cycles *fc;
+
+	if (unlikely(!fw_cycles_off))
+		return;
+
+	/* Stop the firmware cycle clock for the time since start */
+	fc = sbi_scratch_thishart_offset_ptr(fw_cycles_off);
+	fc->idle = csr_read(CSR_MCYCLE) - start;
+}
+
+static bool pmu_fw_cycles_event_valid(uint64_t event_data)
+{
+	return (event_data & 0xffff) < SBI_PMU_FW_CYCLES_MAX;
+}
+
+static uint64_t pmu_fw_cycles_event_read(uint64_t event_data)
+{
+	struct pmu_fw_cycles *fc =
+		sbi_scratch_thishart_offset_ptr(fw_cycles_off);
+
+	return fc->cycles[event_data & 0xffff];
+}
+
+static const struct sbi_pmu_fw_source pmu_fw_cycles_source = {
+	.tag		= SBI_PMU_FW_CYCLES_EDATA_TAG,
+	.event_valid	= pmu_fw_cycles_event_valid,
+	.event_read	= pmu_fw_cycles_event_read,
+};
 
-	if (fcounter)
-		(*fcounter)++;
+static int pmu_fw_cycles_init(void)
+{
+	fw_cycles_off = sbi_scratch_alloc_offset(sizeof(struct pmu_fw_cycles));
+	if (!fw_cycles_off)
+		return SBI_ENOMEM;
+
+	return sbi_pmu_register_fw_source(&pmu_fw_cycles_source);
+}
+
+#else
 
+static inline int pmu_fw_cycles_init(void)
+{
 	return 0;
 }
 
+#endif
+
 unsigned long sbi_pmu_num_ctr(void)
 {
 	return (num_hw_ctrs + SBI_PMU_FW_CTR_MAX);
@@ -962,6 +1656,45 @@ static void pmu_reset_event_map(struct sbi_pmu_hart_state *phs)
 	for (j = 0; j < SBI_PMU_FW_CTR_MAX; j++)
 		phs->fw_counters_data[j] = 0;
 	phs->fw_counters_started = 0;
+	for (j = 0; j < SBI_PMU_FW_MAX; j++)
+		phs->fw_event_counters[j] = 0;
+	pmu_mux_reset(phs);
+}
+
+int sbi_pmu_snapshot_set_shmem(unsigned long smode, unsigned long phys_lo,
+			       unsigned long phys_hi, unsigned long flags)
+{
+	struct sbi_pmu_hart_state *phs = pmu_thishart_state_ptr();
+
+	if (unlikely(!phs))
+		return SBI_EINVAL;
+
+	if (flags)
+		return SBI_EINVAL;
+
+	/* Both halves set to all ones disable the snapshot */
+	if (phys_lo == -1UL && phys_hi == -1UL) {
+		phs->snapshot_addr = PMU_SNAPSHOT_DISABLED;
+		return 0;
+	}
+
+	if (phys_lo & (SBI_PMU_SNAPSHOT_ALIGN - 1))
+		return SBI_EINVAL;
+
+	/* M-mode accesses physical memory directly */
+	if (phys_hi ||
+	    !sbi_domain_check_addr_range(sbi_domain_thishart_ptr(), phys_lo,
+					 sizeof(struct sbi_pmu_snapshot), smode,
+					 SBI_DOMAIN_READ | SBI_DOMAIN_WRITE))
+		return SBI_EINVALID_ADDR;
+
+	sbi_hart_map_saddr(phys_lo, sizeof(struct sbi_pmu_snapshot));
+	sbi_memset((void *)phys_lo, 0, sizeof(struct sbi_pmu_snapshot));
+	sbi_hart_unmap_saddr();
+
+	phs->snapshot_addr = phys_lo;
+
+	return 0;
 }
 
 const struct sbi_pmu_device *sbi_pmu_get_device(void)
@@ -991,6 +1724,7 @@ void sbi_pmu_exit(struct sbi_scratch *scratch)
 		return;
 
 	pmu_reset_event_map(phs);
+	phs->snapshot_addr = PMU_SNAPSHOT_DISABLED;
 }
 
 int sbi_pmu_init(struct sbi_scratch *scratch, bool cold_boot)
@@ -1012,6 +1746,10 @@ int sbi_pmu_init(struct sbi_scratch *scratch, bool cold_boot)
 			return SBI_ENOMEM;
 		}
 
+		rc = pmu_fw_cycles_init();
+		if (rc)
+			return rc;
+
 		plat = sbi_platform_ptr(scratch);
 		/* Initialize hw pmu events */
 		rc = sbi_platform_pmu_init(plat);
@@ -1042,6 +1780,7 @@ int sbi_pmu_init(struct sbi_scratch *scratch, bool cold_boot)
 	}
 
 	pmu_reset_event_map(phs);
+	phs->snapshot_addr = PMU_SNAPSHOT_DISABLED;
 
 	/* First three counters are fixed by the priv spec and we enable it by default */
 	phs->active_events[0] = (SBI_PMU_EVENT_TYPE_HW << SBI_PMU_EVENT_IDX_TYPE_OFFSET) |
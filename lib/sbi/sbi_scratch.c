@@ -18,7 +18,7 @@ u32 last_hartindex_having_scratch = 0;
 u32 hartindex_to_hartid_table[SBI_HARTMASK_MAX_BITS + 1] = { -1U };
 struct sbi_scratch *hartindex_to_scratch_table[SBI_HARTMASK_MAX_BITS + 1] = { 0 };
 
-static spinlock_t extra_lock = SPIN_LOCK_INITIALIZER;
+static DEFINE_SPIN_LOCK(extra_lock);
 static unsigned long extra_offset = SBI_SCRATCH_EXTRA_SPACE_OFFSET;
 
 u32 sbi_hartid_to_hartindex(u32 hartid)
@@ -48,7 +48,7 @@ int sbi_scratch_init(struct sbi_scratch *scratch)
 
 	last_hartindex_having_scratch = plat->hart_count - 1;
 
-	return 0;
+	return mcs_spin_lock_init();
 }
 
 unsigned long sbi_scratch_alloc_offset(unsigned long size)
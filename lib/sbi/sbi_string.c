@@ -8,18 +8,65 @@
  */
 
 /*
- * Simple libc functions. These are not optimized at all and might have some
- * bugs as well. Use any optimized routines from newlib or glibc if required.
+ * Simple libc functions. The memory and common string routines work a
+ * word at a time whenever the pointers allow naturally aligned accesses
+ * because M-mode firmware can't rely on misaligned access support.
  */
 
 #include <sbi/sbi_string.h>
 
+#define WORD_SIZE		sizeof(unsigned long)
+#define WORD_MASK		(WORD_SIZE - 1)
+#define WORD_ALIGNED(p)		(((unsigned long)(p) & WORD_MASK) == 0)
+#define WORD_ONES		(~0UL / 0xff)
+#define WORD_HIGHS		(WORD_ONES << 7)
+
+/* Replicate the low byte of c into every byte of a word */
+static inline unsigned long word_repeat(int c)
+{
+	return WORD_ONES * (unsigned char)c;
+}
+
+/* Check whether any byte of a word is zero */
+static inline bool word_has_zero(unsigned long w)
+{
+#ifdef __riscv_zbb
+	unsigned long r;
+
+	/* orc.b sets a byte to 0xff if any bit in it is set */
+	__asm__ ("orc.b %0, %1" : "=r"(r) : "r"(w));
+
+	return r != ~0UL;
+#else
+	return ((w - WORD_ONES) & ~w & WORD_HIGHS) != 0;
+#endif
+}
+
 /*
   Provides sbi_strcmp for the completeness of supporting string functions.
   it is not recommended to use sbi_strcmp() but use sbi_strncmp instead.
 */
 int sbi_strcmp(const char *a, const char *b)
 {
+	const unsigned long *wa, *wb;
+
+	/* Compare a word at a time if both strings share alignment */
+	if (((unsigned long)a & WORD_MASK) == ((unsigned long)b & WORD_MASK)) {
+		for (; !WORD_ALIGNED(a); a++, b++) {
+			if (*a != *b || *a == '\0')
+				return *a - *b;
+		}
+
+		wa = (const unsigned long *)a;
+		wb = (const unsigned long *)b;
+		while (*wa == *wb && !word_has_zero(*wa)) {
+			wa++;
+			wb++;
+		}
+		a = (const char *)wa;
+		b = (const char *)wb;
+	}
+
 	/* search first diff or end of string */
 	for (; *a == *b && *a != '\0'; a++, b++)
 		;
@@ -42,14 +89,22 @@ int sbi_strncmp(const char *a, const char *b, size_t count)
 
 size_t sbi_strlen(const char *str)
 {
-	unsigned long ret = 0;
+	const char *s = str;
+	const unsigned long *w;
 
-	while (*str != '\0') {
-		ret++;
-		str++;
+	for (; !WORD_ALIGNED(s); s++) {
+		if (*s == '\0')
+			return s - str;
 	}
 
-	return ret;
+	/* Aligned word reads never cross a page boundary */
+	for (w = (const unsigned long *)s; !word_has_zero(*w); w++)
+		;
+
+	for (s = (const char *)w; *s != '\0'; s++)
+		;
+
+	return s - str;
 }
 
 size_t sbi_strnlen(const char *str, size_t count)
@@ -112,6 +167,20 @@ char *sbi_strrchr(const char *s, int c)
 void *sbi_memset(void *s, int c, size_t count)
 {
 	char *temp = s;
+	unsigned long *wtemp, word;
+
+	while (count > 0 && !WORD_ALIGNED(temp)) {
+		count--;
+		*temp++ = c;
+	}
+
+	wtemp = (unsigned long *)temp;
+	word = word_repeat(c);
+	while (count >= WORD_SIZE) {
+		count -= WORD_SIZE;
+		*wtemp++ = word;
+	}
+	temp = (char *)wtemp;
 
 	while (count > 0) {
 		count--;
@@ -125,6 +194,25 @@ void *sbi_memcpy(void *dest, const void *src, size_t count)
 {
 	char *temp1	  = dest;
 	const char *temp2 = src;
+	unsigned long *wtemp1;
+	const unsigned long *wtemp2;
+
+	/* Word copy is only possible when both can become aligned */
+	if ((((unsigned long)temp1 ^ (unsigned long)temp2) & WORD_MASK) == 0) {
+		while (count > 0 && !WORD_ALIGNED(temp1)) {
+			*temp1++ = *temp2++;
+			count--;
+		}
+
+		wtemp1 = (unsigned long *)temp1;
+		wtemp2 = (const unsigned long *)temp2;
+		while (count >= WORD_SIZE) {
+			*wtemp1++ = *wtemp2++;
+			count -= WORD_SIZE;
+		}
+		temp1 = (char *)wtemp1;
+		temp2 = (const char *)wtemp2;
+	}
 
 	while (count > 0) {
 		*temp1++ = *temp2++;
@@ -138,23 +226,38 @@ void *sbi_memmove(void *dest, const void *src, size_t count)
 {
 	char *temp1	  = (char *)dest;
 	const char *temp2 = (char *)src;
+	unsigned long *wtemp1;
+	const unsigned long *wtemp2;
 
 	if (src == dest)
 		return dest;
 
-	if (dest < src) {
-		while (count > 0) {
-			*temp1++ = *temp2++;
+	/* A forward copy never overwrites source not yet copied */
+	if (dest < src)
+		return sbi_memcpy(dest, src, count);
+
+	temp1 = (char *)dest + count;
+	temp2 = (char *)src + count;
+
+	if ((((unsigned long)temp1 ^ (unsigned long)temp2) & WORD_MASK) == 0) {
+		while (count > 0 && !WORD_ALIGNED(temp1)) {
+			*--temp1 = *--temp2;
 			count--;
 		}
-	} else {
-		temp1 = (char *)dest + count - 1;
-		temp2 = (char *)src + count - 1;
 
-		while (count > 0) {
-			*temp1-- = *temp2--;
-			count--;
+		wtemp1 = (unsigned long *)temp1;
+		wtemp2 = (const unsigned long *)temp2;
+		while (count >= WORD_SIZE) {
+			*--wtemp1 = *--wtemp2;
+			count -= WORD_SIZE;
 		}
+		temp1 = (char *)wtemp1;
+		temp2 = (const char *)wtemp2;
+	}
+
+	while (count > 0) {
+		*--temp1 = *--temp2;
+		count--;
 	}
 
 	return dest;
@@ -164,12 +267,34 @@ int sbi_memcmp(const void *s1, const void *s2, size_t count)
 {
 	const char *temp1 = s1;
 	const char *temp2 = s2;
+	const unsigned long *wtemp1, *wtemp2;
+
+	if ((((unsigned long)temp1 ^ (unsigned long)temp2) & WORD_MASK) == 0) {
+		for (; count > 0 && !WORD_ALIGNED(temp1); count--) {
+			if (*temp1 != *temp2)
+				goto done;
+			temp1++;
+			temp2++;
+		}
+
+		/* Skip equal words, the bytes below locate a difference */
+		wtemp1 = (const unsigned long *)temp1;
+		wtemp2 = (const unsigned long *)temp2;
+		while (count >= WORD_SIZE && *wtemp1 == *wtemp2) {
+			wtemp1++;
+			wtemp2++;
+			count -= WORD_SIZE;
+		}
+		temp1 = (const char *)wtemp1;
+		temp2 = (const char *)wtemp2;
+	}
 
 	for (; count > 0 && (*temp1 == *temp2); count--) {
 		temp1++;
 		temp2++;
 	}
 
+done:
 	if (count > 0)
 		return *(unsigned char *)temp1 - *(unsigned char *)temp2;
 	else
@@ -179,6 +304,24 @@ int sbi_memcmp(const void *s1, const void *s2, size_t count)
 void *sbi_memchr(const void *s, int c, size_t count)
 {
 	const unsigned char *temp = s;
+	const unsigned long *wtemp;
+	unsigned long pattern;
+
+	while (count > 0 && !WORD_ALIGNED(temp)) {
+		if ((unsigned char)c == *temp++) {
+			return (void *)(temp - 1);
+		}
+		count--;
+	}
+
+	/* Skip words which can't contain the byte */
+	wtemp = (const unsigned long *)temp;
+	pattern = word_repeat(c);
+	while (count >= WORD_SIZE && !word_has_zero(*wtemp ^ pattern)) {
+		wtemp++;
+		count -= WORD_SIZE;
+	}
+	temp = (const unsigned char *)wtemp;
 
 	while (count > 0) {
 		if ((unsigned char)c == *temp++) {
@@ -17,8 +17,28 @@
 #include <sbi/sbi_pmu.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_timer.h>
+#include <sbi/sbi_trace.h>
+
+/*
+ * Per-HART timer queue. M-mode events are kept in a binary min-heap
+ * ordered by expiry time and share the timer compare register with the
+ * S-mode deadline when Sstc is not available.
+ */
+struct timer_queue {
+	/** S-mode deadline, -1 when none is pending */
+	u64 s_next;
+	/** Timer interrupts saved by coalescing or forwarding deadlines */
+	u64 coalesced;
+	/** Number of queued M-mode events */
+	u32 count;
+	/** Min-heap of queued M-mode events */
+	struct sbi_timer_event *heap[SBI_TIMER_EVENT_MAX];
+};
 
 static unsigned long time_delta_off;
+static unsigned long timer_queue_off;
+static unsigned long timer_slack_us;
+static u64 timer_slack;
 static u64 (*get_time_val)(void);
 static const struct sbi_timer_device *timer_dev = NULL;
 
@@ -129,9 +149,151 @@ void sbi_timer_set_delta_upper(ulong delta_upper)
 	*time_delta |= ((u64)delta_upper << 32);
 }
 
+static inline struct timer_queue *timer_thishart_queue(void)
+{
+	return sbi_scratch_offset_ptr(sbi_scratch_thishart_ptr(),
+				      timer_queue_off);
+}
+
+static void timer_queue_set(struct timer_queue *q, u32 i,
+			    struct sbi_timer_event *ev)
+{
+	q->heap[i] = ev;
+	ev->slot = i + 1;
+}
+
+static void timer_queue_sift_up(struct timer_queue *q, u32 i)
+{
+	struct sbi_timer_event *ev = q->heap[i];
+	u32 parent;
+
+	while (i) {
+		parent = (i - 1) / 2;
+		if (q->heap[parent]->expires <= ev->expires)
+			break;
+		timer_queue_set(q, i, q->heap[parent]);
+		i = parent;
+	}
+	timer_queue_set(q, i, ev);
+}
+
+static void timer_queue_sift_down(struct timer_queue *q, u32 i)
+{
+	struct sbi_timer_event *ev = q->heap[i];
+	u32 child;
+
+	while ((child = 2 * i + 1) < q->count) {
+		if (child + 1 < q->count &&
+		    q->heap[child + 1]->expires < q->heap[child]->expires)
+			child++;
+		if (ev->expires <= q->heap[child]->expires)
+			break;
+		timer_queue_set(q, i, q->heap[child]);
+		i = child;
+	}
+	timer_queue_set(q, i, ev);
+}
+
+static void timer_queue_remove(struct timer_queue *q, u32 i)
+{
+	struct sbi_timer_event *ev = q->heap[i];
+
+	ev->slot = 0;
+	if (i == --q->count)
+		return;
+
+	q->heap[i] = q->heap[q->count];
+	if (i && q->heap[(i - 1) / 2]->expires > q->heap[i]->expires)
+		timer_queue_sift_up(q, i);
+	else
+		timer_queue_sift_down(q, i);
+}
+
+/*
+ * Find the time of the next timer interrupt. With a slack window the
+ * earliest deadline is deferred up to the latest one within the window
+ * so that they are all served by a single interrupt.
+ */
+static u64 timer_queue_next(struct timer_queue *q, bool sstc)
+{
+	u64 first = (q->count) ? q->heap[0]->expires : -1ULL;
+	u64 limit, next;
+	u32 i;
+
+	if (!sstc && q->s_next < first)
+		first = q->s_next;
+
+	if (!timer_slack || first == -1ULL)
+		return first;
+
+	limit = (first < -1ULL - timer_slack) ? first + timer_slack : -2ULL;
+	next = first;
+	for (i = 0; i < q->count; i++) {
+		if (next < q->heap[i]->expires && q->heap[i]->expires <= limit)
+			next = q->heap[i]->expires;
+	}
+	if (!sstc && next < q->s_next && q->s_next <= limit)
+		next = q->s_next;
+
+	return next;
+}
+
+/* Program the timer compare register for the next deadline */
+static void timer_queue_program(struct timer_queue *q, bool sstc)
+{
+	u64 next = timer_queue_next(q, sstc);
+
+	if (next == -1ULL || !timer_dev || !timer_dev->timer_event_start) {
+		csr_clear(CSR_MIE, MIP_MTIP);
+		return;
+	}
+
+	timer_dev->timer_event_start(next);
+	csr_set(CSR_MIE, MIP_MTIP);
+}
+
+int sbi_timer_event_add(struct sbi_timer_event *ev, u64 expires)
+{
+	struct timer_queue *q;
+
+	if (!ev || !ev->callback)
+		return SBI_EINVAL;
+	if (!timer_queue_off || !timer_dev || !timer_dev->timer_event_start)
+		return SBI_ENODEV;
+
+	q = timer_thishart_queue();
+	if (ev->slot)
+		timer_queue_remove(q, ev->slot - 1);
+	else if (q->count == SBI_TIMER_EVENT_MAX)
+		return SBI_ENOSPC;
+
+	ev->expires = expires;
+	q->heap[q->count] = ev;
+	timer_queue_sift_up(q, q->count++);
+
+	if (q->heap[0] == ev || timer_slack)
+		timer_queue_program(q, sbi_hart_has_extension(
+				sbi_scratch_thishart_ptr(), SBI_HART_EXT_SSTC));
+
+	return 0;
+}
+
+void sbi_timer_event_del(struct sbi_timer_event *ev)
+{
+	if (!ev || !ev->slot || !timer_queue_off)
+		return;
+
+	/* The compare register is left alone, an early interrupt is harmless */
+	timer_queue_remove(timer_thishart_queue(), ev->slot - 1);
+}
+
 void sbi_timer_event_start(u64 next_event)
 {
+	struct timer_queue *q;
+
 	sbi_pmu_ctr_incr_fw(SBI_PMU_FW_SET_TIMER);
+	sbi_trace("timer: next event %08lx%08lx\n",
+		  (u32)(next_event >> 32), (u32)next_event);
 
 	/**
 	 * Update the stimecmp directly if available. This allows
@@ -145,24 +307,98 @@ void sbi_timer_event_start(u64 next_event)
 		csr_write(CSR_STIMECMP, next_event);
 #endif
 	} else if (timer_dev && timer_dev->timer_event_start) {
-		timer_dev->timer_event_start(next_event);
+		q = timer_thishart_queue();
+
+		/*
+		 * A deadline which has already passed is forwarded right
+		 * away instead of through a timer interrupt. The compare
+		 * register is reprogrammed so that an earlier S-mode
+		 * deadline does not still fire.
+		 */
+		if (get_time_val && next_event <= get_time_val()) {
+			q->s_next = -1ULL;
+			q->coalesced++;
+			csr_set(CSR_MIP, MIP_STIP);
+			timer_queue_program(q, false);
+			return;
+		}
+
+		q->s_next = next_event;
 		csr_clear(CSR_MIP, MIP_STIP);
+		timer_queue_program(q, false);
 	}
-	csr_set(CSR_MIE, MIP_MTIP);
 }
 
 void sbi_timer_process(void)
 {
+	bool sstc = sbi_hart_has_extension(sbi_scratch_thishart_ptr(),
+					   SBI_HART_EXT_SSTC);
+	struct timer_queue *q = timer_thishart_queue();
+	struct sbi_timer_event *ev;
+	u32 served = 0;
+	u64 now;
+
 	csr_clear(CSR_MIE, MIP_MTIP);
+
+	/* Without a readable time counter every deadline is due */
+	now = (get_time_val) ? get_time_val() : -1ULL;
+
+	while (q->count && q->heap[0]->expires <= now) {
+		ev = q->heap[0];
+		timer_queue_remove(q, 0);
+		ev->callback(ev);
+		served++;
+	}
+
 	/*
 	 * If sstc extension is available, supervisor can receive the timer
-	 * directly without M-mode come in between. This function should
-	 * only invoked if M-mode programs the timer for its own purpose.
+	 * directly without M-mode come in between. Otherwise forward the
+	 * S-mode deadline once it has expired.
 	 */
-	if (!sbi_hart_has_extension(sbi_scratch_thishart_ptr(), SBI_HART_EXT_SSTC))
+	if (!sstc && q->s_next <= now) {
+		q->s_next = -1ULL;
 		csr_set(CSR_MIP, MIP_STIP);
+		served++;
+	}
+
+	/* Every deadline after the first would have needed an interrupt */
+	if (served > 1)
+		q->coalesced += served - 1;
+
+	timer_queue_program(q, sstc);
+}
+
+static void timer_slack_update(void)
+{
+	timer_slack = (timer_dev) ?
+		((u64)timer_dev->timer_freq * timer_slack_us) / 1000000 : 0;
 }
 
+void sbi_timer_set_slack(ulong usecs)
+{
+	timer_slack_us = usecs;
+	timer_slack_update();
+}
+
+static uint64_t timer_pmu_event_read(uint64_t event_data)
+{
+	if (!timer_queue_off)
+		return 0;
+
+	return timer_thishart_queue()->coalesced;
+}
+
+static bool timer_pmu_event_valid(uint64_t event_data)
+{
+	return (event_data & 0xffff) < SBI_TIMER_PMU_EVENT_MAX;
+}
+
+static const struct sbi_pmu_fw_source timer_pmu_source = {
+	.tag		= SBI_TIMER_PMU_EDATA_TAG,
+	.event_valid	= timer_pmu_event_valid,
+	.event_read	= timer_pmu_event_read,
+};
+
 const struct sbi_timer_device *sbi_timer_get_device(void)
 {
 	return timer_dev;
@@ -176,28 +412,61 @@ void sbi_timer_set_device(const struct sbi_timer_device *dev)
 	timer_dev = dev;
 	if (!get_time_val && timer_dev->timer_value)
 		get_time_val = timer_dev->timer_value;
+	timer_slack_update();
+}
+
+static void timer_queue_reset(struct timer_queue *q)
+{
+	u32 i;
+
+	for (i = 0; i < q->count; i++)
+		q->heap[i]->slot = 0;
+	q->count = 0;
+	q->s_next = -1ULL;
 }
 
 int sbi_timer_init(struct sbi_scratch *scratch, bool cold_boot)
 {
 	u64 *time_delta;
+	struct sbi_scratch *rscratch;
 	const struct sbi_platform *plat = sbi_platform_ptr(scratch);
+	u32 i;
+	int rc;
 
 	if (cold_boot) {
 		time_delta_off = sbi_scratch_alloc_offset(sizeof(*time_delta));
 		if (!time_delta_off)
 			return SBI_ENOMEM;
 
+		timer_queue_off =
+			sbi_scratch_alloc_offset(sizeof(struct timer_queue));
+		if (!timer_queue_off)
+			return SBI_ENOMEM;
+
+		/* HARTs may queue events before their own timer init */
+		for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+			rscratch = sbi_hartindex_to_scratch(i);
+			if (rscratch)
+				timer_queue_reset(sbi_scratch_offset_ptr(
+						rscratch, timer_queue_off));
+		}
+
 		if (sbi_hart_has_extension(scratch, SBI_HART_EXT_ZICNTR))
 			get_time_val = get_ticks;
+
+		rc = sbi_pmu_register_fw_source(&timer_pmu_source);
+		if (rc)
+			return rc;
 	} else {
-		if (!time_delta_off)
+		if (!time_delta_off || !timer_queue_off)
 			return SBI_ENOMEM;
 	}
 
 	time_delta = sbi_scratch_offset_ptr(scratch, time_delta_off);
 	*time_delta = 0;
 
+	timer_queue_reset(sbi_scratch_offset_ptr(scratch, timer_queue_off));
+
 	return sbi_platform_timer_init(plat, cold_boot);
 }
 
@@ -209,5 +478,7 @@ void sbi_timer_exit(struct sbi_scratch *scratch)
 	csr_clear(CSR_MIP, MIP_STIP);
 	csr_clear(CSR_MIE, MIP_MTIP);
 
+	timer_queue_reset(sbi_scratch_offset_ptr(scratch, timer_queue_off));
+
 	sbi_platform_timer_exit(sbi_platform_ptr(scratch));
 }
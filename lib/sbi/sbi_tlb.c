@@ -18,6 +18,7 @@
 #include <sbi/sbi_ipi.h>
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_tlb.h>
+#include <sbi/sbi_trace.h>
 #include <sbi/sbi_hfence.h>
 #include <sbi/sbi_string.h>
 #include <sbi/sbi_console.h>
@@ -249,6 +250,7 @@ static void tlb_sync(struct sbi_scratch *scratch)
 {
 	atomic_t *tlb_sync =
 			sbi_scratch_offset_ptr(scratch, tlb_sync_off);
+	unsigned long fwcyc = sbi_pmu_fw_cycles_begin();
 
 	while (atomic_read(tlb_sync) > 0) {
 		/*
@@ -258,6 +260,8 @@ static void tlb_sync(struct sbi_scratch *scratch)
 		tlb_process_once(scratch);
 	}
 
+	sbi_pmu_fw_cycles_end(SBI_PMU_FW_CYCLES_FENCE_WAIT, fwcyc);
+
 	return;
 }
 
@@ -363,6 +367,8 @@ static int tlb_update(struct sbi_scratch *scratch,
 		tlb_process_once(scratch);
 		sbi_dprintf("hart%d: hart%d tlb fifo full\n", curr_hartid,
 			    sbi_hartindex_to_hartid(remote_hartindex));
+		sbi_trace("tlb: hart%u fifo full\n",
+			  sbi_hartindex_to_hartid(remote_hartindex));
 		return SBI_IPI_UPDATE_RETRY;
 	}
 
@@ -0,0 +1,150 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) Nuclei Corporation or its affiliates.
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_barrier.h>
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_console.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_trace.h>
+
+#if CONFIG_SBI_TRACE_RING_SIZE & (CONFIG_SBI_TRACE_RING_SIZE - 1)
+#error "CONFIG_SBI_TRACE_RING_SIZE must be a power of 2"
+#endif
+
+#define TRACE_RING_ENTRIES	CONFIG_SBI_TRACE_RING_SIZE
+
+static unsigned long trace_ring_offset;
+
+static inline struct sbi_trace_ring *trace_ring(struct sbi_scratch *scratch)
+{
+	return sbi_scratch_read_type(scratch, struct sbi_trace_ring *,
+				     trace_ring_offset);
+}
+
+void sbi_trace_log(const char *fmt, unsigned long a0, unsigned long a1,
+		   unsigned long a2, unsigned long a3)
+{
+	struct sbi_trace_entry *e;
+	struct sbi_trace_ring *ring;
+
+	if (!trace_ring_offset)
+		return;
+
+	/* Rings are only written by the owning HART so no locking needed */
+	ring = trace_ring(sbi_scratch_thishart_ptr());
+	if (!ring)
+		return;
+
+	e = &ring->entries[ring->head & (TRACE_RING_ENTRIES - 1)];
+	e->cycle = csr_read(CSR_MCYCLE);
+	e->fmt = (unsigned long)fmt;
+	e->arg[0] = a0;
+	e->arg[1] = a1;
+	e->arg[2] = a2;
+	e->arg[3] = a3;
+	__smp_store_release(&ring->head, ring->head + 1);
+}
+
+static void trace_ring_dump(struct sbi_trace_ring *ring)
+{
+	struct sbi_trace_entry *e;
+	unsigned long i, head;
+
+	head = __smp_load_acquire(&ring->head);
+	sbi_printf("sbi-trace: H %x %x %x %lx %lx\n", ring->hartid,
+		   ring->word_size, ring->nentries, ring->fw_start, head);
+
+	i = (head > ring->nentries) ? head - ring->nentries : 0;
+	for (; i < head; i++) {
+		e = &ring->entries[i & (ring->nentries - 1)];
+		sbi_printf("sbi-trace: E %lx %lx %lx %lx %lx %lx\n",
+			   e->cycle, e->fmt, e->arg[0], e->arg[1],
+			   e->arg[2], e->arg[3]);
+	}
+}
+
+void sbi_trace_dump(void)
+{
+	struct sbi_trace_ring *ring;
+	struct sbi_scratch *scratch;
+	u32 i;
+
+	if (!trace_ring_offset)
+		return;
+
+	/*
+	 * Other HARTs may keep recording while their ring is printed so
+	 * the oldest entries of a busy ring can be torn. The decoder uses
+	 * the head count to detect this.
+	 */
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		scratch = sbi_hartindex_to_scratch(i);
+		if (!scratch)
+			continue;
+		ring = trace_ring(scratch);
+		if (ring)
+			trace_ring_dump(ring);
+	}
+}
+
+void sbi_trace_reset(void)
+{
+	struct sbi_trace_ring *ring;
+	struct sbi_scratch *scratch;
+	u32 i;
+
+	if (!trace_ring_offset)
+		return;
+
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		scratch = sbi_hartindex_to_scratch(i);
+		if (!scratch)
+			continue;
+		ring = trace_ring(scratch);
+		if (ring)
+			__smp_store_release(&ring->head, 0);
+	}
+}
+
+int sbi_trace_init(struct sbi_scratch *scratch, bool cold_boot)
+{
+	struct sbi_trace_ring *ring;
+	struct sbi_scratch *rscratch;
+	unsigned long offset;
+	u32 i;
+
+	if (!cold_boot)
+		return 0;
+
+	offset = sbi_scratch_alloc_type_offset(struct sbi_trace_ring *);
+	if (!offset)
+		return SBI_ENOMEM;
+
+	/* Tracing is best effort so HARTs without a ring are skipped */
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		rscratch = sbi_hartindex_to_scratch(i);
+		if (!rscratch)
+			continue;
+		ring = sbi_zalloc(sizeof(*ring) + TRACE_RING_ENTRIES *
+				  sizeof(struct sbi_trace_entry));
+		if (ring) {
+			ring->magic = SBI_TRACE_MAGIC;
+			ring->hartid = sbi_hartindex_to_hartid(i);
+			ring->word_size = sizeof(unsigned long);
+			ring->nentries = TRACE_RING_ENTRIES;
+			ring->fw_start = rscratch->fw_start;
+		}
+		sbi_scratch_write_type(rscratch, struct sbi_trace_ring *,
+				       offset, ring);
+	}
+
+	__smp_store_release(&trace_ring_offset, offset);
+
+	return 0;
+}
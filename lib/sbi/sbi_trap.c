@@ -22,6 +22,7 @@
 #include <sbi/sbi_scratch.h>
 #include <sbi/sbi_timer.h>
 #include <sbi/sbi_trap.h>
+#include <sbi/sbi_trap_profile.h>
 
 static void __noreturn sbi_trap_error(const char *msg, int rc,
 				      ulong mcause, ulong mtval, ulong mtval2,
@@ -29,6 +30,9 @@ static void __noreturn sbi_trap_error(const char *msg, int rc,
 {
 	u32 hartid = current_hartid();
 
+	/* This HART hangs afterwards so nothing would drain its log ring */
+	sbi_console_sync();
+
 	sbi_printf("%s: hart%d: %s (error %d)\n", __func__, hartid, msg, rc);
 	sbi_printf("%s: hart%d: mcause=0x%" PRILX " mtval=0x%" PRILX "\n",
 		   __func__, hartid, mcause, mtval);
@@ -266,6 +270,7 @@ struct sbi_trap_regs *sbi_trap_handler(struct sbi_trap_regs *regs)
 	const char *msg = "trap handler failed";
 	ulong mcause = csr_read(CSR_MCAUSE);
 	ulong mtval = csr_read(CSR_MTVAL), mtval2 = 0, mtinst = 0;
+	ulong fwcyc = sbi_pmu_fw_cycles_begin();
 	struct sbi_trap_info trap;
 
 	if (misa_extension('H')) {
@@ -283,6 +288,8 @@ struct sbi_trap_regs *sbi_trap_handler(struct sbi_trap_regs *regs)
 			msg = "unhandled local interrupt";
 			goto trap_error;
 		}
+		sbi_trap_profile_end(fwcyc, mcause, mtval, regs);
+		sbi_pmu_fw_cycles_end(SBI_PMU_FW_CYCLES_TOTAL, fwcyc);
 		return regs;
 	}
 
@@ -290,19 +297,23 @@ struct sbi_trap_regs *sbi_trap_handler(struct sbi_trap_regs *regs)
 	case CAUSE_ILLEGAL_INSTRUCTION:
 		rc  = sbi_illegal_insn_handler(mtval, regs);
 		msg = "illegal instruction handler failed";
+		sbi_pmu_fw_cycles_end(SBI_PMU_FW_CYCLES_EMULATION, fwcyc);
 		break;
 	case CAUSE_MISALIGNED_LOAD:
 		rc = sbi_misaligned_load_handler(mtval, mtval2, mtinst, regs);
 		msg = "misaligned load handler failed";
+		sbi_pmu_fw_cycles_end(SBI_PMU_FW_CYCLES_EMULATION, fwcyc);
 		break;
 	case CAUSE_MISALIGNED_STORE:
 		rc  = sbi_misaligned_store_handler(mtval, mtval2, mtinst, regs);
 		msg = "misaligned store handler failed";
+		sbi_pmu_fw_cycles_end(SBI_PMU_FW_CYCLES_EMULATION, fwcyc);
 		break;
 	case CAUSE_SUPERVISOR_ECALL:
 	case CAUSE_MACHINE_ECALL:
 		rc  = sbi_ecall_handler(regs);
 		msg = "ecall handler failed";
+		sbi_pmu_fw_cycles_end(SBI_PMU_FW_CYCLES_ECALL, fwcyc);
 		break;
 	case CAUSE_LOAD_ACCESS:
 	case CAUSE_STORE_ACCESS:
@@ -325,6 +336,8 @@ struct sbi_trap_regs *sbi_trap_handler(struct sbi_trap_regs *regs)
 trap_error:
 	if (rc)
 		sbi_trap_error(msg, rc, mcause, mtval, mtval2, mtinst, regs);
+	sbi_trap_profile_end(fwcyc, mcause, mtval, regs);
+	sbi_pmu_fw_cycles_end(SBI_PMU_FW_CYCLES_TOTAL, fwcyc);
 	return regs;
 }
 
@@ -0,0 +1,256 @@
+/*
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) Nuclei Corporation or its affiliates.
+ */
+
+#include <sbi/riscv_asm.h>
+#include <sbi/riscv_barrier.h>
+#include <sbi/riscv_encoding.h>
+#include <sbi/sbi_domain.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_heap.h>
+#include <sbi/sbi_pmu.h>
+#include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
+#include <sbi/sbi_trap.h>
+#include <sbi/sbi_trap_profile.h>
+
+#define INSN_OPCODE_SYSTEM	0x73
+
+static unsigned long trap_profile_offset;
+
+static inline struct sbi_trap_profile *trap_profile(struct sbi_scratch *scratch)
+{
+	return sbi_scratch_read_type(scratch, struct sbi_trap_profile *,
+				     trap_profile_offset);
+}
+
+static inline void trap_profile_add(struct sbi_trap_profile_stat *st,
+				    unsigned long cycles)
+{
+	st->count++;
+	st->cycles += cycles;
+}
+
+static struct sbi_trap_profile_stat *
+trap_profile_ecall_stat(struct sbi_trap_profile *tp, u32 extid, u32 funcid)
+{
+	struct sbi_trap_profile_ecall *e;
+	u32 i;
+
+	for (i = 0; i < tp->necall; i++) {
+		e = &tp->ecall[i];
+		if (e->extid == extid && e->funcid == funcid)
+			return &e->stat;
+	}
+
+	if (tp->necall == SBI_TRAP_PROFILE_ECALL_MAX)
+		return &tp->ecall_other;
+
+	e = &tp->ecall[tp->necall++];
+	e->extid = extid;
+	e->funcid = funcid;
+	return &e->stat;
+}
+
+static struct sbi_trap_profile_stat *
+trap_profile_csr_stat(struct sbi_trap_profile *tp, u32 csr)
+{
+	struct sbi_trap_profile_csr *c;
+	u32 i;
+
+	for (i = 0; i < tp->ncsr; i++) {
+		c = &tp->csr[i];
+		if (c->csr == csr)
+			return &c->stat;
+	}
+
+	if (tp->ncsr == SBI_TRAP_PROFILE_CSR_MAX)
+		return &tp->csr_other;
+
+	c = &tp->csr[tp->ncsr++];
+	c->csr = csr;
+	return &c->stat;
+}
+
+void sbi_trap_profile_end(unsigned long start, unsigned long mcause,
+			  unsigned long mtval,
+			  const struct sbi_trap_regs *regs)
+{
+	unsigned long cause, funct3;
+	unsigned long cycles = sbi_pmu_fw_cycles_begin() - start;
+	struct sbi_trap_profile *tp;
+
+	if (!trap_profile_offset)
+		return;
+
+	tp = trap_profile(sbi_scratch_thishart_ptr());
+	if (!tp)
+		return;
+
+	trap_profile_add(&tp->total, cycles);
+
+	if (mcause & (1UL << (__riscv_xlen - 1))) {
+		cause = mcause & ~(1UL << (__riscv_xlen - 1));
+		if (cause >= SBI_TRAP_PROFILE_IRQ_MAX)
+			cause = SBI_TRAP_PROFILE_IRQ_MAX - 1;
+		trap_profile_add(&tp->irq[cause], cycles);
+		return;
+	}
+
+	cause = mcause;
+	if (cause >= SBI_TRAP_PROFILE_EXC_MAX)
+		cause = SBI_TRAP_PROFILE_EXC_MAX - 1;
+	trap_profile_add(&tp->exc[cause], cycles);
+
+	switch (mcause) {
+	case CAUSE_SUPERVISOR_ECALL:
+	case CAUSE_MACHINE_ECALL:
+		trap_profile_add(trap_profile_ecall_stat(tp, regs->a7,
+							 regs->a6), cycles);
+		break;
+	case CAUSE_ILLEGAL_INSTRUCTION:
+		/*
+		 * Only CSR instructions reported through MTVAL are grouped,
+		 * funct3 0 is ECALL/EBREAK/xRET and 4 is HLV/HSV
+		 */
+		funct3 = (mtval >> 12) & 0x7;
+		if ((mtval & 0x7f) == INSN_OPCODE_SYSTEM &&
+		    funct3 != 0 && funct3 != 4)
+			trap_profile_add(trap_profile_csr_stat(tp,
+						(mtval >> 20) & 0xfff), cycles);
+		break;
+	default:
+		break;
+	}
+}
+
+const struct sbi_trap_profile *sbi_trap_profile_get(u32 hartid)
+{
+	struct sbi_scratch *scratch;
+
+	if (!trap_profile_offset)
+		return NULL;
+
+	scratch = sbi_hartid_to_scratch(hartid);
+	if (!scratch)
+		return NULL;
+
+	return trap_profile(scratch);
+}
+
+static void trap_profile_clear(struct sbi_trap_profile *tp, u32 hartid)
+{
+	sbi_memset(tp, 0, sizeof(*tp));
+	tp->version = SBI_TRAP_PROFILE_VERSION;
+	tp->hartid = hartid;
+}
+
+void sbi_trap_profile_reset(const struct sbi_domain *dom)
+{
+	struct sbi_trap_profile *tp;
+	struct sbi_scratch *scratch;
+	u32 i, hartid;
+
+	if (!trap_profile_offset)
+		return;
+
+	/* Other HARTs may be updating their profile so this is best effort */
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		scratch = sbi_hartindex_to_scratch(i);
+		if (!scratch)
+			continue;
+		hartid = sbi_hartindex_to_hartid(i);
+		if (!sbi_domain_is_assigned_hart(dom, hartid))
+			continue;
+		tp = trap_profile(scratch);
+		if (tp)
+			trap_profile_clear(tp, hartid);
+	}
+}
+
+static bool trap_profile_event_valid(uint64_t event_data)
+{
+	u32 class, metric;
+
+	class = (event_data >> SBI_TRAP_PROFILE_EDATA_CLASS_SHIFT) & 0xf;
+	metric = (event_data >> SBI_TRAP_PROFILE_EDATA_METRIC_SHIFT) & 0xf;
+
+	return class < SBI_TRAP_PROFILE_CLASS_MAX &&
+	       metric < SBI_TRAP_PROFILE_METRIC_MAX;
+}
+
+static uint64_t trap_profile_event_read(uint64_t event_data)
+{
+	u32 class, metric, cause;
+	struct sbi_trap_profile_stat *st;
+	struct sbi_trap_profile *tp;
+
+	if (!trap_profile_offset)
+		return 0;
+
+	tp = trap_profile(sbi_scratch_thishart_ptr());
+	if (!tp)
+		return 0;
+
+	class = (event_data >> SBI_TRAP_PROFILE_EDATA_CLASS_SHIFT) & 0xf;
+	metric = (event_data >> SBI_TRAP_PROFILE_EDATA_METRIC_SHIFT) & 0xf;
+	cause = event_data & SBI_TRAP_PROFILE_EDATA_CAUSE_MASK;
+
+	switch (class) {
+	case SBI_TRAP_PROFILE_CLASS_EXC:
+		if (cause >= SBI_TRAP_PROFILE_EXC_MAX)
+			cause = SBI_TRAP_PROFILE_EXC_MAX - 1;
+		st = &tp->exc[cause];
+		break;
+	case SBI_TRAP_PROFILE_CLASS_IRQ:
+		if (cause >= SBI_TRAP_PROFILE_IRQ_MAX)
+			cause = SBI_TRAP_PROFILE_IRQ_MAX - 1;
+		st = &tp->irq[cause];
+		break;
+	default:
+		st = &tp->total;
+		break;
+	}
+
+	return (metric == SBI_TRAP_PROFILE_METRIC_CYCLES) ?
+		st->cycles : st->count;
+}
+
+static const struct sbi_pmu_fw_source trap_profile_pmu_source = {
+	.tag		= SBI_TRAP_PROFILE_EDATA_TAG,
+	.event_valid	= trap_profile_event_valid,
+	.event_read	= trap_profile_event_read,
+};
+
+int sbi_trap_profile_init(struct sbi_scratch *scratch, bool cold_boot)
+{
+	struct sbi_trap_profile *tp;
+	struct sbi_scratch *rscratch;
+	unsigned long offset;
+	u32 i;
+
+	if (!cold_boot)
+		return 0;
+
+	offset = sbi_scratch_alloc_type_offset(struct sbi_trap_profile *);
+	if (!offset)
+		return SBI_ENOMEM;
+
+	/* Profiling is best effort so HARTs without a table are skipped */
+	for (i = 0; i <= sbi_scratch_last_hartindex(); i++) {
+		rscratch = sbi_hartindex_to_scratch(i);
+		if (!rscratch)
+			continue;
+		tp = sbi_zalloc(sizeof(*tp));
+		if (tp)
+			trap_profile_clear(tp, sbi_hartindex_to_hartid(i));
+		sbi_scratch_write_type(rscratch, struct sbi_trap_profile *,
+				       offset, tp);
+	}
+
+	__smp_store_release(&trap_profile_offset, offset);
+
+	return sbi_pmu_register_fw_source(&trap_profile_pmu_source);
+}
@@ -7,10 +7,12 @@
  *   Anup Patel <anup.patel@wdc.com>
  */
 
+#include <sbi/riscv_asm.h>
 #include <sbi/riscv_encoding.h>
 #include <sbi/sbi_bitops.h>
 #include <sbi/sbi_hart.h>
 #include <sbi/sbi_scratch.h>
+#include <sbi/sbi_string.h>
 #include <sbi/sbi_trap.h>
 #include <sbi/sbi_unpriv.h>
 
@@ -167,3 +169,176 @@ ulong sbi_get_insn(ulong mepc, struct sbi_trap_info *trap)
 
 	return insn;
 }
+
+/*
+ * Bulk copies move up to UNPRIV_BATCH naturally aligned words with a
+ * single MTVEC swap and MPRV window. MPRV applies to every load and store
+ * so the M-mode side of the copy is accessed outside the window. The
+ * expected trap handler clobbers a4 which tells us that an access trapped.
+ */
+#define UNPRIV_BATCH		4
+
+#define UNPRIV_LOAD_STEP(__w)						\
+	REG_L " %[" #__w "], 0(%[ptr])\n"				\
+	"bnez %[ttmp], 1f\n"						\
+	"addi %[left], %[left], -1\n"					\
+	"beqz %[left], 1f\n"						\
+	"addi %[ptr], %[ptr], " SZREG "\n"
+
+#define UNPRIV_STORE_STEP(__w)						\
+	REG_S " %[" #__w "], 0(%[ptr])\n"				\
+	"bnez %[ttmp], 1f\n"						\
+	"addi %[left], %[left], -1\n"					\
+	"beqz %[left], 1f\n"						\
+	"addi %[ptr], %[ptr], " SZREG "\n"
+
+/* Returns the number of words loaded before a trap or nwords */
+static ulong unpriv_load_batch(const ulong *src, ulong nwords, ulong *w,
+			       struct sbi_trap_info *trap)
+{
+	register ulong tinfo asm("a3");
+	register ulong ttmp asm("a4") = 0;
+	register ulong mstatus = 0;
+	register ulong mtvec = sbi_hart_expected_trap_addr();
+	ulong w0 = 0, w1 = 0, w2 = 0, w3 = 0, left = nwords;
+	ulong ptr = (ulong)src;
+
+	trap->cause = 0;
+
+	asm volatile(
+		"add %[tinfo], %[taddr], zero\n"
+		"csrrw %[mtvec], " STR(CSR_MTVEC) ", %[mtvec]\n"
+		"csrrs %[mstatus], " STR(CSR_MSTATUS) ", %[mprv]\n"
+		".option push\n"
+		".option norvc\n"
+		UNPRIV_LOAD_STEP(w0)
+		UNPRIV_LOAD_STEP(w1)
+		UNPRIV_LOAD_STEP(w2)
+		UNPRIV_LOAD_STEP(w3)
+		".option pop\n"
+		"1: csrw " STR(CSR_MSTATUS) ", %[mstatus]\n"
+		"csrw " STR(CSR_MTVEC) ", %[mtvec]"
+	    : [mstatus] "+&r"(mstatus), [mtvec] "+&r"(mtvec),
+	      [tinfo] "+&r"(tinfo), [ttmp] "+&r"(ttmp),
+	      [left] "+&r"(left), [ptr] "+&r"(ptr),
+	      [w0] "+&r"(w0), [w1] "+&r"(w1), [w2] "+&r"(w2), [w3] "+&r"(w3)
+	    : [mprv] "r"(MSTATUS_MPRV), [taddr] "r"((ulong)trap)
+	    : "memory");
+
+	w[0] = w0;
+	w[1] = w1;
+	w[2] = w2;
+	w[3] = w3;
+
+	return nwords - left;
+}
+
+/* Returns the number of words stored before a trap or nwords */
+static ulong unpriv_store_batch(ulong *dst, ulong nwords, const ulong *w,
+				struct sbi_trap_info *trap)
+{
+	register ulong tinfo asm("a3");
+	register ulong ttmp asm("a4") = 0;
+	register ulong mstatus = 0;
+	register ulong mtvec = sbi_hart_expected_trap_addr();
+	ulong w0 = w[0], w1 = w[1], w2 = w[2], w3 = w[3], left = nwords;
+	ulong ptr = (ulong)dst;
+
+	trap->cause = 0;
+
+	asm volatile(
+		"add %[tinfo], %[taddr], zero\n"
+		"csrrw %[mtvec], " STR(CSR_MTVEC) ", %[mtvec]\n"
+		"csrrs %[mstatus], " STR(CSR_MSTATUS) ", %[mprv]\n"
+		".option push\n"
+		".option norvc\n"
+		UNPRIV_STORE_STEP(w0)
+		UNPRIV_STORE_STEP(w1)
+		UNPRIV_STORE_STEP(w2)
+		UNPRIV_STORE_STEP(w3)
+		".option pop\n"
+		"1: csrw " STR(CSR_MSTATUS) ", %[mstatus]\n"
+		"csrw " STR(CSR_MTVEC) ", %[mtvec]"
+	    : [mstatus] "+&r"(mstatus), [mtvec] "+&r"(mtvec),
+	      [tinfo] "+&r"(tinfo), [ttmp] "+&r"(ttmp),
+	      [left] "+&r"(left), [ptr] "+&r"(ptr)
+	    : [mprv] "r"(MSTATUS_MPRV), [taddr] "r"((ulong)trap),
+	      [w0] "r"(w0), [w1] "r"(w1), [w2] "r"(w2), [w3] "r"(w3)
+	    : "memory");
+
+	return nwords - left;
+}
+
+ulong sbi_copy_from_unpriv(void *dst, const void *src, ulong len,
+			   struct sbi_trap_info *trap)
+{
+	ulong w[UNPRIV_BATCH], addr = (ulong)src, done = 0, n, copied;
+	u8 *d = dst;
+
+	trap->cause = 0;
+
+	while (done < len && ((addr + done) & (sizeof(ulong) - 1))) {
+		d[done] = sbi_load_u8((const u8 *)(addr + done), trap);
+		if (trap->cause)
+			return done;
+		done++;
+	}
+
+	while (len - done >= sizeof(ulong)) {
+		n = (len - done) / sizeof(ulong);
+		if (n > UNPRIV_BATCH)
+			n = UNPRIV_BATCH;
+		copied = unpriv_load_batch((const ulong *)(addr + done), n,
+					   w, trap) * sizeof(ulong);
+		sbi_memcpy(&d[done], w, copied);
+		done += copied;
+		if (trap->cause)
+			return done;
+	}
+
+	while (done < len) {
+		d[done] = sbi_load_u8((const u8 *)(addr + done), trap);
+		if (trap->cause)
+			return done;
+		done++;
+	}
+
+	return done;
+}
+
+ulong sbi_copy_to_unpriv(void *dst, const void *src, ulong len,
+			 struct sbi_trap_info *trap)
+{
+	ulong w[UNPRIV_BATCH], addr = (ulong)dst, done = 0, n, copied;
+	const u8 *s = src;
+
+	trap->cause = 0;
+
+	while (done < len && ((addr + done) & (sizeof(ulong) - 1))) {
+		sbi_store_u8((u8 *)(addr + done), s[done], trap);
+		if (trap->cause)
+			return done;
+		done++;
+	}
+
+	while (len - done >= sizeof(ulong)) {
+		n = (len - done) / sizeof(ulong);
+		if (n > UNPRIV_BATCH)
+			n = UNPRIV_BATCH;
+		sbi_memcpy(w, &s[done], n * sizeof(ulong));
+		copied = unpriv_store_batch((ulong *)(addr + done), n,
+					    w, trap) * sizeof(ulong);
+		done += copied;
+		if (trap->cause)
+			return done;
+	}
+
+	while (done < len) {
+		sbi_store_u8((u8 *)(addr + done), s[done], trap);
+		if (trap->cause)
+			return done;
+		done++;
+	}
+
+	return done;
+}
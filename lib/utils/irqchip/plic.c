@@ -23,6 +23,7 @@
 #define PLIC_ENABLE_STRIDE 0x80
 #define PLIC_CONTEXT_BASE 0x200000
 #define PLIC_CONTEXT_STRIDE 0x1000
+#define PLIC_CONTEXT_CLAIM 0x4
 
 static u32 plic_get_priority(const struct plic_data *plic, u32 source)
 {
@@ -140,6 +141,45 @@ int plic_context_init(const struct plic_data *plic, int context_id,
 	return 0;
 }
 
+int plic_context_enable_irq(const struct plic_data *plic, int context_id,
+			    u32 hwirq, u32 priority)
+{
+	u32 ie;
+
+	if (!plic || context_id < 0 || !hwirq || plic->num_src < hwirq)
+		return SBI_EINVAL;
+
+	plic_set_priority(plic, hwirq, priority);
+
+	ie = plic_get_ie(plic, context_id, hwirq / 32);
+	plic_set_ie(plic, context_id, hwirq / 32, ie | BIT(hwirq % 32));
+
+	plic_set_thresh(plic, context_id, 0);
+
+	return 0;
+}
+
+u32 plic_context_claim(const struct plic_data *plic, int context_id)
+{
+	volatile void *plic_claim;
+
+	plic_claim = (char *)plic->addr + PLIC_CONTEXT_BASE +
+		     PLIC_CONTEXT_STRIDE * context_id + PLIC_CONTEXT_CLAIM;
+
+	return readl(plic_claim);
+}
+
+void plic_context_complete(const struct plic_data *plic, int context_id,
+			   u32 hwirq)
+{
+	volatile void *plic_claim;
+
+	plic_claim = (char *)plic->addr + PLIC_CONTEXT_BASE +
+		     PLIC_CONTEXT_STRIDE * context_id + PLIC_CONTEXT_CLAIM;
+
+	writel(hwirq, plic_claim);
+}
+
 int plic_warm_irqchip_init(const struct plic_data *plic,
 			   int m_cntx_id, int s_cntx_id)
 {
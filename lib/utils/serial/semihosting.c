@@ -15,11 +15,14 @@
 
 #define SYSOPEN     0x01
 #define SYSWRITEC   0x03
+#define SYSWRITE0   0x04
 #define SYSWRITE    0x05
 #define SYSREAD     0x06
 #define SYSREADC    0x07
 #define SYSERRNO	0x13
 
+#define SEMIHOSTING_PUTS_CHUNK	64
+
 static long semihosting_trap(int sysnum, void *addr)
 {
 	register int ret asm ("a0") = sysnum;
@@ -162,16 +165,29 @@ static long semihosting_write(long fd, const void *memp, size_t len)
 
 static unsigned long semihosting_puts(const char *str, unsigned long len)
 {
-	char ch;
+	char buf[SEMIHOSTING_PUTS_CHUNK + 1];
 	long ret;
 	unsigned long i;
 
 	if (semihosting_outfd < 0) {
-		for (i = 0; i < len; i++) {
-			ch = str[i];
-			semihosting_trap(SYSWRITEC, &ch);
+		/*
+		 * SYSWRITE0 stops at the first NUL so copy a chunk into a
+		 * terminated buffer and let the caller retry with the rest.
+		 */
+		for (i = 0; i < len && i < SEMIHOSTING_PUTS_CHUNK; i++) {
+			if (!str[i])
+				break;
+			buf[i] = str[i];
+		}
+		if (i) {
+			buf[i] = '\0';
+			semihosting_trap(SYSWRITE0, buf);
+		} else {
+			buf[0] = str[0];
+			semihosting_trap(SYSWRITEC, buf);
+			i = 1;
 		}
-		ret = len;
+		ret = i;
 	} else
 		ret = semihosting_write(semihosting_outfd, str, len);
 
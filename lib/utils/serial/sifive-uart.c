@@ -25,7 +25,12 @@
 #define UART_RXFIFO_EMPTY	0x80000000
 #define UART_RXFIFO_DATA	0x000000ff
 #define UART_TXCTRL_TXEN	0x1
+#define UART_TXCTRL_TXCNT_SHIFT	16
 #define UART_RXCTRL_RXEN	0x1
+#define UART_IE_RXWM		0x2
+#define UART_IP_TXWM		0x1
+
+#define UART_TXFIFO_DEPTH	8
 
 /* clang-format on */
 
@@ -74,6 +79,32 @@ static void sifive_uart_putc(char ch)
 	set_reg(UART_REG_TXFIFO, ch);
 }
 
+static unsigned long sifive_uart_puts(const char *str, unsigned long len)
+{
+	unsigned long i = 0;
+	u32 room = UART_TXFIFO_DEPTH;
+
+	/*
+	 * The TX watermark is pending only when the FIFO is empty so
+	 * poll it once and then fill the whole FIFO.
+	 */
+	while (!(get_reg(UART_REG_IP) & UART_IP_TXWM))
+		;
+
+	while (i < len && room) {
+		if (str[i] == '\n') {
+			if (room < 2)
+				break;
+			set_reg(UART_REG_TXFIFO, '\r');
+			room--;
+		}
+		set_reg(UART_REG_TXFIFO, str[i++]);
+		room--;
+	}
+
+	return i;
+}
+
 static int sifive_uart_getc(void)
 {
 	u32 ret = get_reg(UART_REG_RXFIFO);
@@ -84,10 +115,20 @@ static int sifive_uart_getc(void)
 	return -1;
 }
 
+static int sifive_uart_rx_irq_enable(void)
+{
+	/* RX watermark count is zero so any received character fires */
+	set_reg(UART_REG_IE, UART_IE_RXWM);
+
+	return 0;
+}
+
 static struct sbi_console_device sifive_console = {
 	.name = "sifive_uart",
 	.console_putc = sifive_uart_putc,
-	.console_getc = sifive_uart_getc
+	.console_puts = sifive_uart_puts,
+	.console_getc = sifive_uart_getc,
+	.console_rx_irq_enable = sifive_uart_rx_irq_enable
 };
 
 int sifive_uart_init(unsigned long base, u32 in_freq, u32 baudrate)
@@ -103,8 +144,9 @@ int sifive_uart_init(unsigned long base, u32 in_freq, u32 baudrate)
 	/* Disable interrupts */
 	set_reg(UART_REG_IE, 0);
 
-	/* Enable TX */
-	set_reg(UART_REG_TXCTRL, UART_TXCTRL_TXEN);
+	/* Enable TX with the watermark raised only on an empty FIFO */
+	set_reg(UART_REG_TXCTRL,
+		UART_TXCTRL_TXEN | (1 << UART_TXCTRL_TXCNT_SHIFT));
 
 	/* Enable Rx */
 	set_reg(UART_REG_RXCTRL, UART_RXCTRL_RXEN);
@@ -39,6 +39,11 @@
 #define UART_LSR_DR		0x01	/* Receiver data ready */
 #define UART_LSR_BRK_ERROR_BITS	0x1E	/* BI, FE, PE, OE bits */
 
+#define UART_IER_RDI		0x01	/* Receiver data interrupt */
+
+#define UART_IIR_FIFO_MASK	0xC0	/* FIFOs enabled */
+#define UART_FIFO_DEPTH		16	/* 16550A compatible FIFO */
+
 /* clang-format on */
 
 static volatile char *uart8250_base;
@@ -46,6 +51,7 @@ static u32 uart8250_in_freq;
 static u32 uart8250_baudrate;
 static u32 uart8250_reg_width;
 static u32 uart8250_reg_shift;
+static u32 uart8250_fifo_depth;
 
 static u32 get_reg(u32 num)
 {
@@ -79,6 +85,38 @@ static void uart8250_putc(char ch)
 	set_reg(UART_THR_OFFSET, ch);
 }
 
+static void uart8250_wait_thre(void)
+{
+	while ((get_reg(UART_LSR_OFFSET) & UART_LSR_THRE) == 0)
+		;
+}
+
+static unsigned long uart8250_puts(const char *str, unsigned long len)
+{
+	unsigned long i = 0;
+	u32 room = uart8250_fifo_depth;
+
+	/* THRE means the whole TX FIFO is empty */
+	uart8250_wait_thre();
+
+	while (i < len && room) {
+		if (str[i] == '\n') {
+			if (room < 2 && 1 < uart8250_fifo_depth)
+				break;
+			set_reg(UART_THR_OFFSET, '\r');
+			/* Without FIFO wait for the holding register again */
+			if (!--room) {
+				uart8250_wait_thre();
+				room = 1;
+			}
+		}
+		set_reg(UART_THR_OFFSET, str[i++]);
+		room--;
+	}
+
+	return i;
+}
+
 static int uart8250_getc(void)
 {
 	if (get_reg(UART_LSR_OFFSET) & UART_LSR_DR)
@@ -86,10 +124,19 @@ static int uart8250_getc(void)
 	return -1;
 }
 
+static int uart8250_rx_irq_enable(void)
+{
+	set_reg(UART_IER_OFFSET, UART_IER_RDI);
+
+	return 0;
+}
+
 static struct sbi_console_device uart8250_console = {
 	.name = "uart8250",
 	.console_putc = uart8250_putc,
-	.console_getc = uart8250_getc
+	.console_puts = uart8250_puts,
+	.console_getc = uart8250_getc,
+	.console_rx_irq_enable = uart8250_rx_irq_enable
 };
 
 int uart8250_init(unsigned long base, u32 in_freq, u32 baudrate, u32 reg_shift,
@@ -124,6 +171,12 @@ int uart8250_init(unsigned long base, u32 in_freq, u32 baudrate, u32 reg_shift,
 	set_reg(UART_LCR_OFFSET, 0x03);
 	/* Enable FIFO */
 	set_reg(UART_FCR_OFFSET, 0x01);
+	/* Without FIFOs only the holding register can be filled at once */
+	if ((get_reg(UART_IIR_OFFSET) & UART_IIR_FIFO_MASK) ==
+	    UART_IIR_FIFO_MASK)
+		uart8250_fifo_depth = UART_FIFO_DEPTH;
+	else
+		uart8250_fifo_depth = 1;
 	/* No modem control DTR RTS */
 	set_reg(UART_MCR_OFFSET, 0x00);
 	/* Clear line status */
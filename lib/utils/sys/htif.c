@@ -45,6 +45,7 @@
 	((uint64_t)((fromhost_value) >> HTIF_DATA_SHIFT) & HTIF_DATA_MASK)
 
 #define PK_SYS_write 64
+#define PK_STDOUT_FD 1
 
 volatile uint64_t tohost __attribute__((section(".htif")));
 volatile uint64_t fromhost __attribute__((section(".htif")));
@@ -54,7 +55,7 @@ static uint64_t *htif_tohost = NULL;
 static bool htif_custom = false;
 
 static int htif_console_buf;
-static spinlock_t htif_lock = SPIN_LOCK_INITIALIZER;
+static DEFINE_SPIN_LOCK(htif_lock);
 
 static inline uint64_t __read_tohost(void)
 {
@@ -127,7 +128,7 @@ static int set_custom_addr(bool custom_addr,
 	return 0;
 }
 
-#if __riscv_xlen == 32
+#if __riscv_xlen == 32 || defined(CONFIG_SYS_HTIF_BULK_WRITE)
 static void do_tohost_fromhost(uint64_t dev, uint64_t cmd, uint64_t data)
 {
 	spin_lock(&htif_lock);
@@ -149,15 +150,23 @@ static void do_tohost_fromhost(uint64_t dev, uint64_t cmd, uint64_t data)
 	spin_unlock(&htif_lock);
 }
 
-static void htif_putc(char ch)
+static long htif_syscall_write(const char *str, unsigned long len)
 {
-	/* HTIF devices are not supported on RV32, so do a proxy write call */
 	volatile uint64_t magic_mem[8];
 	magic_mem[0] = PK_SYS_write;
-	magic_mem[1] = HTIF_DEV_CONSOLE;
-	magic_mem[2] = (uint64_t)(uintptr_t)&ch;
-	magic_mem[3] = HTIF_CONSOLE_CMD_PUTC;
+	magic_mem[1] = PK_STDOUT_FD;
+	magic_mem[2] = (uint64_t)(uintptr_t)str;
+	magic_mem[3] = len;
 	do_tohost_fromhost(HTIF_DEV_SYSTEM, 0, (uint64_t)(uintptr_t)magic_mem);
+	return (long)magic_mem[0];
+}
+#endif
+
+#if __riscv_xlen == 32
+static void htif_putc(char ch)
+{
+	/* HTIF devices are not supported on RV32, so do a proxy write call */
+	htif_syscall_write(&ch, 1);
 }
 #else
 static void htif_putc(char ch)
@@ -168,6 +177,19 @@ static void htif_putc(char ch)
 }
 #endif
 
+#ifdef CONFIG_SYS_HTIF_BULK_WRITE
+static unsigned long htif_puts(const char *str, unsigned long len)
+{
+	long ret;
+
+	/* One proxied write for the whole string instead of one per byte */
+	ret = htif_syscall_write(str, len);
+
+	/* Drop the output on host errors instead of retrying forever */
+	return (ret > 0) ? ret : len;
+}
+#endif
+
 static int htif_getc(void)
 {
 	int ch;
@@ -194,6 +216,9 @@ static int htif_getc(void)
 static struct sbi_console_device htif_console = {
 	.name = "htif",
 	.console_putc = htif_putc,
+#ifdef CONFIG_SYS_HTIF_BULK_WRITE
+	.console_puts = htif_puts,
+#endif
 	.console_getc = htif_getc
 };
 
@@ -19,6 +19,15 @@
 
 static unsigned long mtimer_ptr_offset;
 
+/* MTIMER registers of a HART, resolved once by warm init */
+struct mtimer_hart {
+	volatile u64 *mtimecmp;
+	volatile u64 *mtime;
+	bool mmio64;
+};
+
+static unsigned long mtimer_hart_offset;
+
 #define mtimer_get_hart_data_ptr(__scratch)				\
 	sbi_scratch_read_type((__scratch), void *, mtimer_ptr_offset)
 
@@ -56,58 +65,52 @@ static void mtimer_time_wr32(bool timecmp, u64 value, volatile u64 *addr)
 	writel_relaxed((u32)value, (void *)(addr));
 }
 
+static inline struct mtimer_hart *mtimer_thishart(void)
+{
+	return sbi_scratch_thishart_offset_ptr(mtimer_hart_offset);
+}
+
 static u64 mtimer_value(void)
 {
-	struct sbi_scratch *scratch = sbi_scratch_thishart_ptr();
-	struct aclint_mtimer_data *mt;
+	struct mtimer_hart *mh = mtimer_thishart();
 
-	mt = mtimer_get_hart_data_ptr(scratch);
-	if (!mt)
+	if (!mh->mtime)
 		return 0;
 
 	/* Read MTIMER Time Value */
-	return mt->time_rd((void *)mt->mtime_addr);
+#if __riscv_xlen != 32
+	if (mh->mmio64)
+		return readq_relaxed(mh->mtime);
+#endif
+	return mtimer_time_rd32(mh->mtime);
 }
 
-static void mtimer_event_stop(void)
+static inline void mtimer_write_timecmp(u64 value)
 {
-	u32 target_hart = current_hartid();
-	struct sbi_scratch *scratch;
-	struct aclint_mtimer_data *mt;
-	u64 *time_cmp;
+	struct mtimer_hart *mh = mtimer_thishart();
 
-	scratch = sbi_hartid_to_scratch(target_hart);
-	if (!scratch)
+	if (!mh->mtimecmp)
 		return;
 
-	mt = mtimer_get_hart_data_ptr(scratch);
-	if (!mt)
+#if __riscv_xlen != 32
+	if (mh->mmio64) {
+		writeq_relaxed(value, mh->mtimecmp);
 		return;
+	}
+#endif
+	mtimer_time_wr32(true, value, mh->mtimecmp);
+}
 
+static void mtimer_event_stop(void)
+{
 	/* Clear MTIMER Time Compare */
-	time_cmp = (void *)mt->mtimecmp_addr;
-	mt->time_wr(true, -1ULL, &time_cmp[target_hart - mt->first_hartid]);
+	mtimer_write_timecmp(-1ULL);
 }
 
 static void mtimer_event_start(u64 next_event)
 {
-	u32 target_hart = current_hartid();
-	struct sbi_scratch *scratch;
-	struct aclint_mtimer_data *mt;
-	u64 *time_cmp;
-
-	scratch = sbi_hartid_to_scratch(target_hart);
-	if (!scratch)
-		return;
-
-	mt = mtimer_get_hart_data_ptr(scratch);
-	if (!mt)
-		return;
-
 	/* Program MTIMER Time Compare */
-	time_cmp = (void *)mt->mtimecmp_addr;
-	mt->time_wr(true, next_event,
-		    &time_cmp[target_hart - mt->first_hartid]);
+	mtimer_write_timecmp(next_event);
 }
 
 static struct sbi_timer_device mtimer = {
@@ -157,6 +160,7 @@ int aclint_mtimer_warm_init(void)
 	u32 target_hart = current_hartid();
 	struct sbi_scratch *scratch;
 	struct aclint_mtimer_data *mt;
+	struct mtimer_hart *mh;
 
 	scratch = sbi_hartid_to_scratch(target_hart);
 	if (!scratch)
@@ -169,10 +173,19 @@ int aclint_mtimer_warm_init(void)
 	/* Sync-up MTIME register */
 	aclint_mtimer_sync(mt);
 
-	/* Clear Time Compare */
+	/* Resolve registers used by the timer callbacks of this HART */
 	mt_time_cmp = (void *)mt->mtimecmp_addr;
-	mt->time_wr(true, -1ULL,
-		    &mt_time_cmp[target_hart - mt->first_hartid]);
+	mh = sbi_scratch_offset_ptr(scratch, mtimer_hart_offset);
+	mh->mtimecmp = &mt_time_cmp[target_hart - mt->first_hartid];
+	mh->mtime = (mt->mtime_size) ? (void *)mt->mtime_addr : NULL;
+#if __riscv_xlen != 32
+	mh->mmio64 = mt->has_64bit_mmio;
+#else
+	mh->mmio64 = false;
+#endif
+
+	/* Clear Time Compare */
+	mtimer_write_timecmp(-1ULL);
 
 	return 0;
 }
@@ -202,6 +215,12 @@ int aclint_mtimer_cold_init(struct aclint_mtimer_data *mt,
 		if (!mtimer_ptr_offset)
 			return SBI_ENOMEM;
 	}
+	if (!mtimer_hart_offset) {
+		mtimer_hart_offset =
+			sbi_scratch_alloc_type_offset(struct mtimer_hart);
+		if (!mtimer_hart_offset)
+			return SBI_ENOMEM;
+	}
 
 	/* Initialize private data */
 	aclint_mtimer_set_reference(mt, reference);
@@ -227,6 +246,14 @@ int aclint_mtimer_cold_init(struct aclint_mtimer_data *mt,
 		if (!scratch)
 			continue;
 		mtimer_set_hart_data_ptr(scratch, mt);
+
+		/* Let the trap entry read MTIME for TIME CSR emulation */
+#if __riscv_xlen != 32
+		if (mt->mtime_size && mt->has_64bit_mmio)
+#else
+		if (mt->mtime_size)
+#endif
+			scratch->time_addr = mt->mtime_addr;
 	}
 
 	if (!mt->mtime_size) {
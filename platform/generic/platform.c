@@ -16,6 +16,7 @@
 #include <sbi/sbi_platform.h>
 #include <sbi/sbi_string.h>
 #include <sbi/sbi_system.h>
+#include <sbi/sbi_timer.h>
 #include <sbi/sbi_tlb.h>
 #include <sbi_utils/fdt/fdt_domain.h>
 #include <sbi_utils/fdt/fdt_fixup.h>
@@ -306,7 +307,8 @@ static int generic_extensions_init(struct sbi_hart_features *hfeatures)
 static int generic_domains_init(void)
 {
 	void *fdt = fdt_get_address();
-	int offset, ret;
+	const fdt32_t *val;
+	int offset, ret, len;
 
 	ret = fdt_domains_populate(fdt);
 	if (ret < 0)
@@ -317,9 +319,15 @@ static int generic_domains_init(void)
 	if (offset >= 0) {
 		offset = fdt_node_offset_by_compatible(fdt, offset,
 						       "opensbi,config");
-		if (offset >= 0 &&
-		    fdt_get_property(fdt, offset, "system-suspend-test", NULL))
+	}
+
+	if (offset >= 0) {
+		if (fdt_get_property(fdt, offset, "system-suspend-test", NULL))
 			sbi_system_suspend_test_enable();
+
+		val = fdt_getprop(fdt, offset, "timer-slack-us", &len);
+		if (val && len >= sizeof(fdt32_t))
+			sbi_timer_set_slack(fdt32_to_cpu(*val));
 	}
 
 	return 0;
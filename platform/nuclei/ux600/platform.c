@@ -13,14 +13,19 @@
 #include <sbi/riscv_encoding.h>
 #include <sbi/sbi_console.h>
 #include <sbi/sbi_const.h>
+#include <sbi/sbi_error.h>
+#include <sbi/sbi_irqchip.h>
 #include <sbi/sbi_platform.h>
+#include <sbi/sbi_pmu.h>
 #include <sbi/sbi_system.h>
 #include <sbi_utils/fdt/fdt_helper.h>
 #include <sbi_utils/fdt/fdt_fixup.h>
+#include <sbi_utils/fdt/fdt_pmu.h>
 #include <sbi_utils/ipi/aclint_mswi.h>
 #include <sbi_utils/irqchip/plic.h>
 #include <sbi_utils/serial/sifive-uart.h>
 #include <sbi_utils/timer/aclint_mtimer.h>
+#include <libfdt.h>
 
 /* clang-format off */
 
@@ -60,6 +65,42 @@
 
 #define UX600_TIMER_VALUE()		readl((void *)UX600_NUCLEI_TIMER_ADDR)
 
+/*
+ * CPU frequency calibration runs for at least UX600_CALIB_MIN_TICKS timer
+ * ticks and is extended until UX600_CALIB_MIN_CYCLES CPU cycles have been
+ * counted, keeping the polling error below about 0.1%, but never beyond
+ * UX600_CALIB_MAX_TICKS.
+ */
+#define UX600_CALIB_MIN_TICKS		4
+#define UX600_CALIB_MAX_TICKS		100
+#define UX600_CALIB_MIN_CYCLES		(1U << 17)
+
+/*
+ * Nuclei HPM event selector: mhpmevent[3:0] selects the event class,
+ * mhpmevent[8:4] the event within it and mhpmevent[31:28] enables
+ * counting in M (bit 31), S (bit 29) and U (bit 28) mode.
+ */
+#define UX600_HPM_EVENT(sel, idx)	((sel) | ((idx) << 4) | \
+					 UX600_HPM_EVENT_SU_EN)
+#define UX600_HPM_EVENT_SU_EN		(0x3UL << 28)
+#define UX600_HPM_SEL_COMMIT		0
+#define UX600_HPM_SEL_MEMORY		1
+#define UX600_HPM_COMMIT_BRANCH		8
+#define UX600_HPM_COMMIT_BRANCH_MISS	24
+#define UX600_HPM_MEMORY_ICACHE_MISS	1
+#define UX600_HPM_MEMORY_DCACHE_MISS	2
+#define UX600_HPM_MEMORY_ITLB_MISS	3
+#define UX600_HPM_MEMORY_DTLB_MISS	4
+
+/* Every programmable counter can count every event */
+#define UX600_HPM_CTR_MASK		0xfffffff8
+
+#define UX600_CACHE_EVENT(id, op, res)					\
+	((SBI_PMU_EVENT_TYPE_HW_CACHE << SBI_PMU_EVENT_IDX_TYPE_OFFSET) |	\
+	 (SBI_PMU_HW_CACHE_##id << SBI_PMU_EVENT_HW_CACHE_ID_OFFSET) |	\
+	 (SBI_PMU_HW_CACHE_OP_##op << SBI_PMU_EVENT_HW_CACHE_OPS_ID_OFFSET) | \
+	 SBI_PMU_HW_CACHE_RESULT_##res)
+
 /* clang-format on */
 static u32 ux600_clk_freq = 8000000;
 
@@ -89,12 +130,29 @@ static struct aclint_mtimer_data mtimer = {
 	.has_64bit_mmio = true,
 };
 
-static u32 measure_cpu_freq(u32 n)
+/* Built-in SBI event to Nuclei HPM event selector map */
+static const struct fdt_pmu_hw_event_select_map ux600_hpm_events[] = {
+	{ SBI_PMU_HW_BRANCH_INSTRUCTIONS,
+	  UX600_HPM_EVENT(UX600_HPM_SEL_COMMIT, UX600_HPM_COMMIT_BRANCH) },
+	{ SBI_PMU_HW_BRANCH_MISSES,
+	  UX600_HPM_EVENT(UX600_HPM_SEL_COMMIT, UX600_HPM_COMMIT_BRANCH_MISS) },
+	{ UX600_CACHE_EVENT(L1D, READ, MISS),
+	  UX600_HPM_EVENT(UX600_HPM_SEL_MEMORY, UX600_HPM_MEMORY_DCACHE_MISS) },
+	{ UX600_CACHE_EVENT(L1I, READ, MISS),
+	  UX600_HPM_EVENT(UX600_HPM_SEL_MEMORY, UX600_HPM_MEMORY_ICACHE_MISS) },
+	{ UX600_CACHE_EVENT(DTLB, READ, MISS),
+	  UX600_HPM_EVENT(UX600_HPM_SEL_MEMORY, UX600_HPM_MEMORY_DTLB_MISS) },
+	{ UX600_CACHE_EVENT(ITLB, READ, MISS),
+	  UX600_HPM_EVENT(UX600_HPM_SEL_MEMORY, UX600_HPM_MEMORY_ITLB_MISS) },
+};
+
+static u32 measure_cpu_freq(void)
 {
 	u32 start_mtime, delta_mtime;
 	u32 mtime_freq = UX600_TIMER_FREQ;
 	u32 tmp = (u32)UX600_TIMER_VALUE();
 	u32 start_mcycle, delta_mcycle, freq;
+	u32 n = UX600_CALIB_MIN_TICKS;
 
 	/* Don't start measuring until we see an mtime tick */
 	do {
@@ -107,7 +165,21 @@ static u32 measure_cpu_freq(u32 n)
 		delta_mtime = (u32)UX600_TIMER_VALUE() - start_mtime;
 	} while (delta_mtime < n);
 
+	/* Extend the window on slow clocks so that it ends on a tick */
 	delta_mcycle = csr_read(mcycle) - start_mcycle;
+	if (delta_mcycle < UX600_CALIB_MIN_CYCLES) {
+		n = (delta_mcycle) ?
+		    (u32)(((u64)UX600_CALIB_MIN_CYCLES * n) / delta_mcycle) + 1 :
+		    UX600_CALIB_MAX_TICKS;
+		if (n > UX600_CALIB_MAX_TICKS)
+			n = UX600_CALIB_MAX_TICKS;
+
+		do {
+			delta_mtime = (u32)UX600_TIMER_VALUE() - start_mtime;
+		} while (delta_mtime < n);
+
+		delta_mcycle = csr_read(mcycle) - start_mcycle;
+	}
 
 	freq = (delta_mcycle / delta_mtime) * mtime_freq
 		+ ((delta_mcycle % delta_mtime) * mtime_freq) / delta_mtime;
@@ -115,16 +187,56 @@ static u32 measure_cpu_freq(u32 n)
 	return freq;
 }
 
+#ifdef CONFIG_PLATFORM_NUCLEI_UX600_CPU_FREQ_FDT
+static u32 ux600_fdt_clk_freq(void)
+{
+	void *fdt = fdt_get_address();
+	const fdt32_t *val;
+	int cpus_offset, cpu_offset, len;
+	u64 freq;
+
+	if (!fdt)
+		return 0;
+
+	cpus_offset = fdt_path_offset(fdt, "/cpus");
+	if (cpus_offset < 0)
+		return 0;
+
+	fdt_for_each_subnode(cpu_offset, fdt, cpus_offset) {
+		val = fdt_getprop(fdt, cpu_offset, "clock-frequency", &len);
+		if (!val)
+			continue;
+		if (len == sizeof(fdt32_t))
+			return fdt32_to_cpu(*val);
+		if (len == sizeof(fdt64_t)) {
+			freq = fdt64_ld((const fdt64_t *)val);
+			return (freq >> 32) ? 0 : (u32)freq;
+		}
+		return 0;
+	}
+
+	return 0;
+}
+#else
+static inline u32 ux600_fdt_clk_freq(void)
+{
+	return 0;
+}
+#endif
+
 static u32 ux600_get_clk_freq(void)
 {
 	u32 cpu_freq;
 
-	/* warm up */
-	measure_cpu_freq(1);
-	/* measure for real */
-	cpu_freq = measure_cpu_freq(100);
+	/* A known frequency avoids the calibration altogether */
+	if (CONFIG_PLATFORM_NUCLEI_UX600_CPU_FREQ)
+		return CONFIG_PLATFORM_NUCLEI_UX600_CPU_FREQ;
+
+	cpu_freq = ux600_fdt_clk_freq();
+	if (cpu_freq)
+		return cpu_freq;
 
-	return cpu_freq;
+	return measure_cpu_freq();
 }
 
 static int ux600_system_reset_check(u32 type, u32 reason)
@@ -153,8 +265,9 @@ static int ux600_early_init(bool cold_boot)
 	if (cold_boot)
 		sbi_system_reset_add_device(&ux600_reset);
 
-	/* Measure CPU Frequency using Timer */
-	ux600_clk_freq = ux600_get_clk_freq();
+	/* Measure CPU Frequency using Timer once, it does not change */
+	if (cold_boot)
+		ux600_clk_freq = ux600_get_clk_freq();
 
 	/* Init GPIO UART pinmux */
 	regval = readl((void *)(UX600_GPIO_ADDR + UX600_GPIO_IOF_SEL_OFS)) &
@@ -190,10 +303,66 @@ static int ux600_console_init(void)
 				UX600_UART_BAUDRATE);
 }
 
+#ifdef CONFIG_SBI_CONSOLE_RX_IRQ
+
+static u32 ux600_uart_irq;
+static u32 ux600_uart_irq_hart;
+static int ux600_uart_irq_cntx = -1;
+
+static int ux600_m_irqfn(struct sbi_trap_regs *regs)
+{
+	u32 hwirq;
+
+	while ((hwirq = plic_context_claim(&plic, ux600_uart_irq_cntx))) {
+		if (hwirq == ux600_uart_irq)
+			sbi_console_rx_process();
+		plic_context_complete(&plic, ux600_uart_irq_cntx, hwirq);
+	}
+
+	return 0;
+}
+
+static void ux600_console_rx_irq_init(int m_cntx_id)
+{
+	const fdt32_t *val;
+	void *fdt = fdt_get_address();
+	int nodeoff, len;
+
+	/* Take the debug UART interrupt number from the DT */
+	nodeoff = fdt_node_offset_by_compatible(fdt, -1, "sifive,uart0");
+	if (nodeoff < 0)
+		return;
+	val = fdt_getprop(fdt, nodeoff, "interrupts", &len);
+	if (!val || len < sizeof(fdt32_t))
+		return;
+	ux600_uart_irq = fdt32_to_cpu(*val);
+
+	if (plic_context_enable_irq(&plic, m_cntx_id, ux600_uart_irq, 1))
+		return;
+	ux600_uart_irq_hart = current_hartid();
+	ux600_uart_irq_cntx = m_cntx_id;
+
+	sbi_irqchip_set_irqfn(ux600_m_irqfn);
+	sbi_console_rx_irq_enable();
+}
+
+static void ux600_console_rx_irq_warm_init(u32 hartid)
+{
+	if (ux600_uart_irq_cntx < 0 || hartid != ux600_uart_irq_hart)
+		return;
+
+	/* plic_warm_irqchip_init() disabled the UART source again */
+	plic_context_enable_irq(&plic, ux600_uart_irq_cntx, ux600_uart_irq, 1);
+	sbi_irqchip_set_irqfn(ux600_m_irqfn);
+}
+
+#endif
+
 static int ux600_irqchip_init(bool cold_boot)
 {
 	int rc;
 	u32 hartid = current_hartid();
+	int m_cntx_id = (hartid) ? (2 * hartid - 1) : 0;
 
 	if (cold_boot) {
 		rc = plic_cold_irqchip_init(&plic);
@@ -201,8 +370,20 @@ static int ux600_irqchip_init(bool cold_boot)
 			return rc;
 	}
 
-	return plic_warm_irqchip_init(&plic, (hartid) ? (2 * hartid - 1) : 0,
-				      (hartid) ? (2 * hartid) : -1);
+	rc = plic_warm_irqchip_init(&plic, m_cntx_id,
+				    (hartid) ? (2 * hartid) : -1);
+	if (rc)
+		return rc;
+
+#ifdef CONFIG_SBI_CONSOLE_RX_IRQ
+	/* UART receive interrupts are taken by the coldboot HART */
+	if (cold_boot)
+		ux600_console_rx_irq_init(m_cntx_id);
+	else
+		ux600_console_rx_irq_warm_init(hartid);
+#endif
+
+	return 0;
 }
 
 static int ux600_ipi_init(bool cold_boot)
@@ -231,6 +412,57 @@ static int ux600_timer_init(bool cold_boot)
 	return aclint_mtimer_warm_init();
 }
 
+static int ux600_pmu_init(void)
+{
+	int i, rc;
+
+	/* A riscv,pmu node in the device tree takes precedence */
+	rc = fdt_pmu_setup(fdt_get_address());
+	if (rc != SBI_ENOENT)
+		return rc;
+
+	/*
+	 * Any selector value may be used as a raw event. This goes first
+	 * because the generic events are stored with a zero select and
+	 * select_mask, which the raw map check would take as a duplicate.
+	 */
+	rc = sbi_pmu_add_raw_event_counter_map(0, 0, UX600_HPM_CTR_MASK);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < array_size(ux600_hpm_events); i++) {
+		rc = sbi_pmu_add_hw_event_counter_map(ux600_hpm_events[i].eidx,
+						      ux600_hpm_events[i].eidx,
+						      UX600_HPM_CTR_MASK);
+		if (rc)
+			return rc;
+	}
+
+	return 0;
+}
+
+static uint64_t ux600_pmu_xlate_to_mhpmevent(uint32_t event_idx,
+					     uint64_t data)
+{
+	uint64_t evt_val;
+	int i;
+
+	/* data is valid only for raw events and is equal to event selector */
+	if (event_idx == SBI_PMU_EVENT_RAW_IDX)
+		return data;
+
+	evt_val = fdt_pmu_get_select_value(event_idx);
+	if (evt_val)
+		return evt_val;
+
+	for (i = 0; i < array_size(ux600_hpm_events); i++) {
+		if (ux600_hpm_events[i].eidx == event_idx)
+			return ux600_hpm_events[i].select;
+	}
+
+	return 0;
+}
+
 const struct sbi_platform_operations platform_ops = {
 	.early_init		= ux600_early_init,
 	.final_init		= ux600_final_init,
@@ -238,6 +470,8 @@ const struct sbi_platform_operations platform_ops = {
 	.irqchip_init		= ux600_irqchip_init,
 	.ipi_init		= ux600_ipi_init,
 	.timer_init		= ux600_timer_init,
+	.pmu_init		= ux600_pmu_init,
+	.pmu_xlate_to_mhpmevent	= ux600_pmu_xlate_to_mhpmevent,
 };
 
 const struct sbi_platform platform = {
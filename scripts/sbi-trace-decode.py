@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+#
+# SPDX-License-Identifier: BSD-2-Clause
+#
+# Copyright (c) Nuclei Corporation or its affiliates.
+#
+# Decode OpenSBI binary trace rings (CONFIG_SBI_TRACE).
+#
+# The firmware only records the address of each format string, so the
+# firmware ELF is needed to turn entries back into text. Input is either a
+# console log containing "sbi-trace:" records (printed by the firmware
+# diagnostics extension) or raw memory dumps of one or more rings taken
+# with a debugger.
+#
+# usage: sbi-trace-decode.py <fw_elf> [<console_log|ring_dump> ...]
+
+import re
+import struct
+import sys
+
+TRACE_MAGIC = 0x52544253
+TRACE_MAX_ARGS = 4
+
+
+class Elf:
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            self.data = f.read()
+        d = self.data
+        if d[:4] != b'\x7fELF':
+            raise ValueError('%s: not an ELF file' % path)
+        self.is64 = d[4] == 2
+        self.end = '<' if d[5] == 1 else '>'
+        if self.is64:
+            hdr = struct.unpack_from(self.end + 'QQQIHHHHHH', d, 0x18)
+        else:
+            hdr = struct.unpack_from(self.end + 'IIIIHHHHHH', d, 0x18)
+        phoff, shoff = hdr[1], hdr[2]
+        phentsize, phnum, shentsize, shnum = hdr[5:9]
+
+        self.segments = []
+        for i in range(phnum):
+            off = phoff + i * phentsize
+            if self.is64:
+                (ptype, _, poff, vaddr, _, filesz, _, _) = \
+                    struct.unpack_from(self.end + 'IIQQQQQQ', d, off)
+            else:
+                (ptype, poff, vaddr, _, filesz, _, _, _) = \
+                    struct.unpack_from(self.end + 'IIIIIIII', d, off)
+            if ptype == 1:
+                self.segments.append((vaddr, poff, filesz))
+
+        self.symbols = {}
+        sections = []
+        for i in range(shnum):
+            off = shoff + i * shentsize
+            if self.is64:
+                sh = struct.unpack_from(self.end + 'IIQQQQIIQQ', d, off)
+            else:
+                sh = struct.unpack_from(self.end + 'IIIIIIIIII', d, off)
+            sections.append(sh)
+        for sh in sections:
+            if sh[1] != 2:
+                continue
+            strtab = sections[sh[6]]
+            entsize = 24 if self.is64 else 16
+            for j in range(sh[5] // entsize):
+                off = sh[4] + j * entsize
+                if self.is64:
+                    name, _, _, _, value, _ = \
+                        struct.unpack_from(self.end + 'IBBHQQ', d, off)
+                else:
+                    name, value, _, _, _, _ = \
+                        struct.unpack_from(self.end + 'IIIBBH', d, off)
+                self.symbols[self.cstring_at(strtab[4] + name)] = value
+
+    def cstring_at(self, off):
+        end = self.data.find(b'\0', off)
+        return self.data[off:end].decode('utf-8', 'replace')
+
+    def base(self):
+        if '_fw_start' in self.symbols:
+            return self.symbols['_fw_start']
+        return min(s[0] for s in self.segments)
+
+    def string(self, addr):
+        for vaddr, poff, filesz in self.segments:
+            if vaddr <= addr < vaddr + filesz:
+                return self.cstring_at(poff + addr - vaddr)
+        return None
+
+
+class Ring:
+    def __init__(self, hartid, word_size, nentries, fw_start, head):
+        self.hartid = hartid
+        self.word_size = word_size
+        self.nentries = nentries
+        self.fw_start = fw_start
+        self.head = head
+        self.entries = []
+
+
+def parse_console(text):
+    rings = []
+    for line in text.splitlines():
+        m = re.search(r'sbi-trace: ([HE]) ([0-9a-fA-F ]+)$', line.strip())
+        if not m:
+            continue
+        vals = [int(v, 16) for v in m.group(2).split()]
+        if m.group(1) == 'H' and len(vals) == 5:
+            rings.append(Ring(*vals))
+        elif m.group(1) == 'E' and rings and \
+                len(vals) == 2 + TRACE_MAX_ARGS:
+            rings[-1].entries.append(vals)
+    return rings
+
+
+def parse_dump(data):
+    rings = []
+    off = 0
+    while off + 16 <= len(data):
+        magic, hartid, word_size, nentries = \
+            struct.unpack_from('<IIII', data, off)
+        if magic != TRACE_MAGIC or word_size not in (4, 8):
+            off += 4
+            continue
+        w = 'Q' if word_size == 8 else 'I'
+        fw_start, head = struct.unpack_from('<' + w * 2, data, off + 16)
+        ring = Ring(hartid, word_size, nentries, fw_start, head)
+        base = off + 16 + 2 * word_size
+        esize = (2 + TRACE_MAX_ARGS) * word_size
+        first = head - nentries if head > nentries else 0
+        for i in range(first, head):
+            eoff = base + (i % nentries) * esize
+            if eoff + esize > len(data):
+                break
+            ring.entries.append(list(struct.unpack_from(
+                '<' + w * (2 + TRACE_MAX_ARGS), data, eoff)))
+        rings.append(ring)
+        off = base + nentries * esize
+    return rings
+
+
+def render(fmt, args, word_size):
+    bits = word_size * 8
+    out = []
+    argi = 0
+    pos = 0
+    spec = re.compile(r'%([-+ #0]*)(\d*)(?:\.(\d+))?(l{0,2}|z|h{0,2})'
+                      r'([diuxXcsp%])')
+    for m in spec.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        conv = m.group(5)
+        if conv == '%':
+            out.append('%')
+            continue
+        val = args[argi] if argi < len(args) else 0
+        argi += 1
+        if m.group(4) in ('', 'h', 'hh') and conv != 'p':
+            width = 32
+        else:
+            width = bits
+        val &= (1 << width) - 1
+        if conv in 'di' and val >> (width - 1):
+            val -= 1 << width
+        pyspec = '%' + m.group(1) + m.group(2)
+        if m.group(3):
+            pyspec += '.' + m.group(3)
+        if conv == 'p':
+            out.append('0x%x' % val)
+        elif conv == 's':
+            out.append('<str@0x%x>' % val)
+        elif conv == 'c':
+            out.append(chr(val & 0xff))
+        else:
+            out.append((pyspec + {'u': 'd', 'i': 'd'}.get(conv, conv))
+                       % val)
+    out.append(fmt[pos:])
+    return ''.join(out)
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write('usage: %s <fw_elf> [<console_log|ring_dump>'
+                         ' ...]\n' % argv[0])
+        return 1
+
+    elf = Elf(argv[1])
+    rings = []
+    inputs = argv[2:] or ['-']
+    for path in inputs:
+        if path == '-':
+            data = sys.stdin.buffer.read()
+        else:
+            with open(path, 'rb') as f:
+                data = f.read()
+        if struct.pack('<I', TRACE_MAGIC) in data and b'sbi-trace:' \
+                not in data:
+            rings += parse_dump(data)
+        else:
+            rings += parse_console(data.decode('utf-8', 'replace'))
+
+    events = []
+    for ring in rings:
+        offset = ring.fw_start - elf.base()
+        if ring.head > ring.nentries:
+            sys.stderr.write('hart%d: %d older entries overwritten\n' %
+                             (ring.hartid, ring.head - ring.nentries))
+        for e in ring.entries:
+            fmt = elf.string(e[1] - offset)
+            if fmt is None:
+                text = '<unknown format 0x%x>\n' % e[1]
+            else:
+                text = render(fmt, e[2:], ring.word_size)
+            events.append((e[0], ring.hartid, text))
+
+    # mcycle is per-HART so ordering across HARTs is only approximate
+    events.sort()
+    start = events[0][0] if events else 0
+    for cycle, hartid, text in events:
+        sys.stdout.write('%12d hart%-3d %s' % (cycle - start, hartid, text))
+        if not text.endswith('\n'):
+            sys.stdout.write('\n')
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))